@@ -0,0 +1,206 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "board.h"
+#include "patterns.h"
+#include "search.h"
+#include "sgf.h"
+
+using namespace std;
+
+
+/*
+ * Batch analysis of SGF game records. Each record's main line is replayed,
+ * and every few positions are searched with a fixed budget. The search keeps
+ * its state in globals, so the worker pool is made of processes rather than
+ * threads: each worker takes every n-th file, and writes one line per
+ * position to a shared pipe, which the parent copies to the output. Lines are
+ * written whole, so lines from different workers never interleave.
+ *
+ * Usage: go-batch [options] files...
+ *   --playouts N   playouts per position (default 1000)
+ *   --time S       seconds per position, on top of the playout limit
+ *   --every K      analyze every K-th position (default 1)
+ *   --workers N    worker processes (default: one per core)
+ *   --seed S       search seed, offset by the worker number
+ *   --output FILE  where to write the results (default: stdout)
+ *
+ * Each output line is tab separated: file, move number, color to play, the
+ * move played in the record, the engine's best move, its winrate, its score
+ * lead, and its visits.
+ */
+
+extern int boardSize;
+extern int arraySize;
+extern Board game;
+extern float komi;
+extern int playouts;
+extern uint64_t keyStack[4096];
+extern int keyStackSize;
+
+bool debugOutput = false;
+
+const string COLUMNS = "ABCDEFGHJKLMNOPQRSTUVWXYZ";
+
+static AnalysisMove bestFound;
+static bool found;
+
+static void recordBest(const vector<AnalysisMove> &moves) {
+    bestFound = moves[0];
+    found = true;
+}
+
+static string moveToString(Move m) {
+    if (m == MOVE_PASS)
+        return "pass";
+    return COLUMNS[getX(m) - 1] + to_string(getY(m));
+}
+
+// Analyzes one game record, writing a line per analyzed position to fd.
+// Returns the number of positions analyzed.
+static int analyzeFile(const string &filename, int every, int out) {
+    SgfGame record;
+    if (!loadSgf(filename, record)) {
+        cerr << "Could not read " << filename << endl;
+        return 0;
+    }
+    if (record.boardSize < 3 || record.boardSize > 21) {
+        cerr << "Unsupported board size in " << filename << endl;
+        return 0;
+    }
+
+    boardSize = record.boardSize;
+    arraySize = boardSize + 2;
+    komi = record.komi;
+    game.reset();
+    keyStackSize = 0;
+    resetSearchState();
+    replaySgf(record, 0, game, keyStack, keyStackSize, 4096);
+
+    AnalysisOptions options;
+    options.intervalMs = 1 << 30;
+    options.maxMoves = 1;
+    options.callback = recordBest;
+
+    int analyzed = 0;
+    Move last = MOVE_PASS;
+    for (unsigned int i = 0; i < record.moves.size(); i++) {
+        Player p = record.colors[i];
+        if (i % every == 0) {
+            found = false;
+            analyzePosition(p, last, playouts, options);
+
+            string line = filename + "\t" + to_string(i + 1)
+                + "\t" + ((p == BLACK) ? "B" : "W")
+                + "\t" + moveToString(record.moves[i]);
+            if (found) {
+                line += "\t" + moveToString(bestFound.m)
+                      + "\t" + to_string(bestFound.winrate)
+                      + "\t" + to_string(bestFound.scoreLead)
+                      + "\t" + to_string(bestFound.visits);
+            }
+            else
+                line += "\tpass\t0\t0\t0";
+            line += "\n";
+            if (write(out, line.data(), line.size()) < 0)
+                return analyzed;
+            analyzed++;
+        }
+
+        if (keyStackSize == 4096
+         || !playSgfMove(game, p, record.moves[i], keyStack, keyStackSize)) {
+            cerr << "Illegal move " << i + 1 << " in " << filename << endl;
+            break;
+        }
+        last = record.moves[i];
+    }
+    return analyzed;
+}
+
+int main(int argc, char **argv) {
+    initZobristTable();
+    initPatterns();
+
+    int every = 1;
+    int workers = thread::hardware_concurrency();
+    uint64_t seed = 0;
+    string output;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg == "--playouts" && i+1 < argc)
+            playouts = stoi(string(argv[++i]));
+        else if (arg == "--time" && i+1 < argc)
+            setTimeLimit(stod(string(argv[++i])));
+        else if (arg == "--every" && i+1 < argc)
+            every = max(1, stoi(string(argv[++i])));
+        else if (arg == "--workers" && i+1 < argc)
+            workers = stoi(string(argv[++i]));
+        else if (arg == "--seed" && i+1 < argc)
+            seed = stoull(string(argv[++i]));
+        else if (arg == "--output" && i+1 < argc)
+            output = string(argv[++i]);
+        else
+            files.push_back(arg);
+    }
+    if (workers < 1)
+        workers = 1;
+
+    FILE *out = stdout;
+    if (!output.empty()) {
+        out = fopen(output.c_str(), "w");
+        if (out == NULL) {
+            cerr << "Could not open " << output << endl;
+            return 1;
+        }
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        cerr << "Could not create pipe" << endl;
+        return 1;
+    }
+
+    auto startTime = chrono::steady_clock::now();
+    vector<pid_t> children;
+    for (int w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            setSearchSeed(seed + w);
+            for (unsigned int i = w; i < files.size(); i += workers)
+                analyzeFile(files[i], every, fds[1]);
+            close(fds[1]);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    close(fds[1]);
+
+    // Copy the results to the output as they arrive
+    char buffer[1 << 16];
+    long positions = 0;
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        fwrite(buffer, 1, n, out);
+        for (ssize_t i = 0; i < n; i++)
+            positions += (buffer[i] == '\n');
+    }
+    close(fds[0]);
+    for (unsigned int i = 0; i < children.size(); i++)
+        waitpid(children[i], NULL, 0);
+    if (out != stdout)
+        fclose(out);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    cerr << positions << " positions in " << elapsed.count() << " sec, "
+         << positions / elapsed.count() / workers
+         << " positions/sec per worker" << endl;
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <vector>
+#include "benchmark.h"
+#include "board.h"
+#include "rng.h"
+#include "search.h"
+
+extern int boardSize;
+extern int arraySize;
+extern Board game;
+extern float komi;
+extern uint64_t keyStack[4096];
+extern int keyStackSize;
+
+// Playouts timed on their own, and the budget of each timed search
+const int BENCHMARK_PLAYOUTS = 1000;
+const int BENCHMARK_SEARCH_PLAYOUTS = 1000;
+
+
+// Sets up the position after a fixed number of random moves on the engine's
+// game board, and returns the last move. The number of moves depends on the
+// phase: none, a tenth of the board, a third, and two thirds.
+Move setUpBenchmarkPosition(int size, int phase, Player &toMove) {
+    boardSize = size;
+    arraySize = size + 2;
+    game.reset();
+    keyStackSize = 0;
+
+    const int moveCounts[4] = {0, size * size / 10, size * size / 3,
+        2 * size * size / 3};
+    int moves = moveCounts[phase];
+
+    Rng rng(BENCHMARK_SEED + 100 * size + phase);
+    Player p = BLACK;
+    Move last = MOVE_PASS;
+    for (int i = 0; i < moves; i++) {
+        MoveList legalMoves = game.getLegalMoves(p);
+        Move m = MOVE_PASS;
+        while (legalMoves.size() > 0) {
+            int index = rng.bounded(legalMoves.size());
+            Move candidate = legalMoves.get(index);
+            legalMoves.removeFast(index);
+            if (game.isLegalNonEye(p, candidate)) {
+                m = candidate;
+                break;
+            }
+        }
+        if (m == MOVE_PASS)
+            break;
+        keyStack[keyStackSize++] = game.getZobristKey();
+        game.doMove(p, m);
+        last = m;
+        p = otherPlayer(p);
+    }
+
+    toMove = p;
+    return last;
+}
+
+// The number of moves made on a board so far: every move places a stone,
+// which is either still there or was captured
+static int movesMade(Board &b) {
+    int total = b.getCapturedStones(BLACK) + b.getCapturedStones(WHITE);
+    for (int y = 1; y <= boardSize; y++)
+        for (int x = 1; x <= boardSize; x++)
+            total += (b.getStone(x, y) == BLACK || b.getStone(x, y) == WHITE);
+    return total;
+}
+
+void runBenchmark(std::ostream &out) {
+    // The game in progress is put back afterwards
+    int savedSize = boardSize;
+    float savedKomi = komi;
+    Board savedGame(game);
+    std::vector<uint64_t> savedKeys(keyStack, keyStack + keyStackSize);
+    saveSearchState();
+    komi = 7.5;
+
+    out << std::left << std::setw(6) << "size" << std::setw(9) << "phase"
+        << std::right << std::setw(14) << "playouts/s" << std::setw(10)
+        << "length" << std::setw(12) << "nodes/s" << std::setw(14)
+        << "ms/genmove" << std::endl;
+
+    double totalPlayoutTime = 0.0, totalSearchTime = 0.0;
+    int positions = 0;
+    for (int s = 0; s < NUM_BENCHMARK_SIZES; s++) {
+        for (int phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+            Player p;
+            Move last = setUpBenchmarkPosition(BENCHMARK_SIZES[s], phase, p);
+
+            // Playouts alone, with the engine's current playout policy
+            resetSearchState();
+            Rng rng(BENCHMARK_SEED);
+            long playoutMoves = 0;
+            int before = movesMade(game);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < BENCHMARK_PLAYOUTS; i++) {
+                Board copy(game);
+                Player winner = playRandomGame(p, copy, rng);
+                if (winner == EMPTY) {
+                    float myScore, oppScore;
+                    scoreGame(p, copy, myScore, oppScore);
+                }
+                playoutMoves += movesMade(copy) - before;
+            }
+            std::chrono::duration<double> playoutTime =
+                std::chrono::steady_clock::now() - start;
+
+            // A full search, from the same seed every time
+            setSearchSeed(BENCHMARK_SEED);
+            resetSearchState();
+            start = std::chrono::steady_clock::now();
+            searchUncached(p, last, BENCHMARK_SEARCH_PLAYOUTS);
+            std::chrono::duration<double> searchTime =
+                std::chrono::steady_clock::now() - start;
+
+            out << std::left << std::setw(6) << BENCHMARK_SIZES[s]
+                << std::setw(9) << BENCHMARK_PHASES[phase] << std::right
+                << std::fixed << std::setprecision(0) << std::setw(14)
+                << BENCHMARK_PLAYOUTS / playoutTime.count()
+                << std::setprecision(1) << std::setw(10)
+                << (double) playoutMoves / BENCHMARK_PLAYOUTS
+                << std::setprecision(0) << std::setw(12)
+                << BENCHMARK_SEARCH_PLAYOUTS / searchTime.count()
+                << std::setprecision(1) << std::setw(14)
+                << 1000 * searchTime.count() << std::endl;
+
+            totalPlayoutTime += playoutTime.count();
+            totalSearchTime += searchTime.count();
+            positions++;
+        }
+    }
+
+    out << std::left << std::setw(15) << "total" << std::right
+        << std::setprecision(0) << std::setw(14)
+        << positions * BENCHMARK_PLAYOUTS / totalPlayoutTime
+        << std::setw(10) << "" << std::setw(12)
+        << positions * BENCHMARK_SEARCH_PLAYOUTS / totalSearchTime
+        << std::setprecision(1) << std::setw(14)
+        << 1000 * totalSearchTime / positions << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+
+    boardSize = savedSize;
+    arraySize = savedSize + 2;
+    komi = savedKomi;
+    game = savedGame;
+    std::copy(savedKeys.begin(), savedKeys.end(), keyStack);
+    keyStackSize = savedKeys.size();
+    restoreSearchState();
+}
@@ -0,0 +1,27 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <ostream>
+#include "types.h"
+
+/*
+ * A fixed speed benchmark. Positions at four stages of a game, on 9x9, 13x13
+ * and 19x19, are generated from a fixed seed. For each, playouts are timed on
+ * their own, then a search with a fixed playout budget is timed, bypassing
+ * the opening book and the search cache.
+ *
+ * The benchmark plays on the engine's game board. The game in progress, and
+ * the search state carried between its moves, are restored afterwards.
+ */
+const uint64_t BENCHMARK_SEED = 12345;
+const int NUM_BENCHMARK_SIZES = 3;
+const int BENCHMARK_SIZES[NUM_BENCHMARK_SIZES] = {9, 13, 19};
+const int NUM_BENCHMARK_PHASES = 4;
+const char *const BENCHMARK_PHASES[NUM_BENCHMARK_PHASES] = {
+    "empty", "opening", "middle", "endgame"
+};
+
+Move setUpBenchmarkPosition(int size, int phase, Player &toMove);
+void runBenchmark(std::ostream &out);
+
+#endif
@@ -1,6 +1,8 @@
+#include <cstdlib>
 #include <iostream>
 #include <random>
 #include "board.h"
+#include "stats.h"
 
 
 int boardSize = 19;
@@ -30,11 +32,44 @@ inline int zobristIndex(Player p, int x, int y) {
 }
 
 
+Move transformMove(Move m, int symmetry) {
+    if (m == MOVE_PASS || m == MOVE_NULL)
+        return m;
+    int x = getX(m);
+    int y = getY(m);
+    if (symmetry & 1)
+        x = boardSize + 1 - x;
+    if (symmetry & 2)
+        y = boardSize + 1 - y;
+    if (symmetry & 4)
+        return coordToMove(y, x);
+    return coordToMove(x, y);
+}
+
+
 Board::Board() {
     init();
 }
 
 Board::Board(const Board &other) {
+    copy(other);
+}
+
+Board::~Board() {
+    deinit();
+}
+
+Board& Board::operator=(const Board &other) {
+    if (this != &other) {
+        deinit();
+        copy(other);
+    }
+    return *this;
+}
+
+// Copies another board's state into this one, which holds no allocations
+void Board::copy(const Board &other) {
+    countStat(COUNT_BOARD_COPIES);
     pieces = new Stone[arraySize*arraySize];
     for (int i = 0; i < arraySize*arraySize; i++) {
         pieces[i] = other.pieces[i];
@@ -43,6 +78,8 @@ Board::Board(const Board &other) {
     blackCaptures = other.blackCaptures;
     whiteCaptures = other.whiteCaptures;
     zobristKey = other.zobristKey;
+    koPoint = other.koPoint;
+    koColor = other.koColor;
     nextID = other.nextID;
     chainID = new int[arraySize*arraySize];
     for (int i = 0; i < arraySize*arraySize; i++)
@@ -51,12 +88,21 @@ Board::Board(const Board &other) {
     unsigned int numChains = other.chainList.size();
     for (unsigned int i = 0; i < numChains; i++) {
         Chain *node = other.chainList.get(i);
+        countStat(COUNT_CHAIN_ALLOCATIONS);
         chainList.add(new Chain(*(node)));
     }
-}
 
-Board::~Board() {
-    deinit();
+    for (int c = 0; c < 2; c++) {
+        for (unsigned int i = 0; i < other.atariChains[c].size(); i++) {
+            atariChains[c].add(other.atariChains[c].get(i));
+            atariLiberties[c].add(other.atariLiberties[c].get(i));
+        }
+        for (int i = 0; i < 12; i++) {
+            legalBits[c][i] = other.legalBits[c][i];
+            settledBits[c][i] = other.settledBits[c][i];
+        }
+    }
+    numDirty = 0;
 }
 
 
@@ -69,6 +115,8 @@ Board::~Board() {
  * Updates the board with a move. Assumes that the move is legal.
  */
 void Board::doMove(Player p, Move m) {
+    // A ko ban only lasts for one move, including a pass
+    koPoint = MOVE_NULL;
     if (m == MOVE_PASS)
         return;
 
@@ -77,7 +125,8 @@ void Board::doMove(Player p, Move m) {
 
     assert(pieces[index(x, y)] == EMPTY);
     assert(chainID[index(x, y)] == 0);
-    
+    numDirty = 0;
+
     pieces[index(x, y)] = p;
     zobristKey ^= zobristTable[zobristIndex(p, x, y)];
 
@@ -95,6 +144,7 @@ void Board::doMove(Player p, Move m) {
         chainID[index(x, y)] = nextID;
 
         // Add this chain to the list of chains
+        countStat(COUNT_CHAIN_ALLOCATIONS);
         Chain *cargo = new Chain(p, nextID);
         cargo->add(m);
         cargo->liberties = 0;
@@ -208,6 +258,8 @@ void Board::doMove(Player p, Move m) {
 
 
     // Update opponent liberties
+    int capturesBefore = blackCaptures + whiteCaptures;
+    Move capturedSquare = MOVE_NULL;
     int eastID = (east == victim) * chainID[index(x+1, y)];
     int westID = (west == victim) * chainID[index(x-1, y)];
     int northID = (north == victim) * chainID[index(x, y+1)];
@@ -218,8 +270,12 @@ void Board::doMove(Player p, Move m) {
         int nodeIndex = searchChainsByID(node, eastID);
         node->removeLiberty(node->findLiberty(m));
 
-        if (node->liberties == 0)
+        if (node->liberties == 0) {
+            capturedSquare = node->squares[0];
             captureChain(node, nodeIndex);
+        }
+        else
+            updateAtari(node);
     }
 
     if (westID && westID != eastID) {
@@ -227,8 +283,12 @@ void Board::doMove(Player p, Move m) {
         int nodeIndex = searchChainsByID(node, westID);
         node->removeLiberty(node->findLiberty(m));
 
-        if (node->liberties == 0)
+        if (node->liberties == 0) {
+            capturedSquare = node->squares[0];
             captureChain(node, nodeIndex);
+        }
+        else
+            updateAtari(node);
     }
 
     if (northID && northID != eastID && northID != westID) {
@@ -236,8 +296,12 @@ void Board::doMove(Player p, Move m) {
         int nodeIndex = searchChainsByID(node, northID);
         node->removeLiberty(node->findLiberty(m));
 
-        if (node->liberties == 0)
+        if (node->liberties == 0) {
+            capturedSquare = node->squares[0];
             captureChain(node, nodeIndex);
+        }
+        else
+            updateAtari(node);
     }
 
     if (southID && southID != eastID && southID != westID && southID != northID) {
@@ -245,8 +309,12 @@ void Board::doMove(Player p, Move m) {
         int nodeIndex = searchChainsByID(node, southID);
         node->removeLiberty(node->findLiberty(m));
 
-        if (node->liberties == 0)
+        if (node->liberties == 0) {
+            capturedSquare = node->squares[0];
             captureChain(node, nodeIndex);
+        }
+        else
+            updateAtari(node);
     }
 
     // Check for a suicide
@@ -256,8 +324,34 @@ void Board::doMove(Player p, Move m) {
 
     if (node->liberties == 0)
         captureChain(node, nodeIndex);
+    else {
+        updateAtari(node);
+
+        // A single stone that captured a single stone and is left in atari
+        // cannot be recaptured immediately
+        if (blackCaptures + whiteCaptures == capturesBefore + 1
+         && node->size == 1 && node->liberties == 1) {
+            koPoint = capturedSquare;
+            koColor = victim;
+        }
+    }
 
 
+    // Legality can only have changed at and next to the move, at captured
+    // stones, and at the liberties of chains that entered or left atari
+    if (numDirty > 64) {
+        updateAllLegality();
+    }
+    else {
+        updateLegality(x, y);
+        updateLegality(x+1, y);
+        updateLegality(x-1, y);
+        updateLegality(x, y+1);
+        updateLegality(x, y-1);
+        for (int i = 0; i < numDirty; i++)
+            updateLegality(getX(dirtyPoints[i]), getY(dirtyPoints[i]));
+    }
+
     // A debugging check
     assert(!checkChains());
 
@@ -276,60 +370,45 @@ void Board::doMove(Player p, Move m) {
 bool Board::isMoveValid(Player p, Move m) {
     if (m == MOVE_PASS)
         return true;
+    if (m == koPoint && p == koColor)
+        return false;
 
     int x = getX(m);
     int y = getY(m);
     assert(pieces[index(x, y)] == EMPTY);
 
-    // First check if the move makes a capture, since if so then
-    // it cannot possibly be a suicide
-    Player victim = otherPlayer(p);
-    int eastID = (pieces[index(x+1, y)] == victim) * chainID[index(x+1, y)];
-    int westID = (pieces[index(x-1, y)] == victim) * chainID[index(x-1, y)];
-    int northID = (pieces[index(x, y+1)] == victim) * chainID[index(x, y+1)];
-    int southID = (pieces[index(x, y-1)] == victim) * chainID[index(x, y-1)];
-
-    if (eastID) {
-        Chain *node = nullptr;
-        searchChainsByID(node, eastID);
-        if (node->liberties == 1)
-            return true;
-    }
-    if (westID) {
-        Chain *node = nullptr;
-        searchChainsByID(node, westID);
-        if (node->liberties == 1)
-            return true;
-    }
-    if (northID) {
-        Chain *node = nullptr;
-        searchChainsByID(node, northID);
-        if (node->liberties == 1)
-            return true;
-    }
-    if (southID) {
-        Chain *node = nullptr;
-        searchChainsByID(node, southID);
-        if (node->liberties == 1)
-            return true;
-    }
+    return isLegalIgnoringKo(p, x, y);
+}
 
-    if (isEye(victim, m))
+/*
+ * Returns true if the move is legal, does not fill one of p's own eyes, and
+ * is not in a settled area. This is a single bit test, since the answer is
+ * maintained incrementally by doMove(). Unlike isMoveValid(), occupied points
+ * are allowed and simply return false.
+ */
+bool Board::isLegalNonEye(Player p, Move m) {
+    if (m == koPoint && p == koColor)
         return false;
+    int i = index(getX(m), getY(m));
+    return (legalBits[p-1][i >> 6] >> (i & 63)) & 1;
+}
 
-    pieces[index(x, y)] = p;
-
-    // Suicides are illegal
-    if (pieces[index(x+1, y)] && pieces[index(x-1, y)]
-     && pieces[index(x, y+1)] && pieces[index(x, y-1)]) {
-        if (doCaptures<false>(p, coordToMove(x, y))) {
-            pieces[index(x, y)] = EMPTY;
-            return false;
-        }
+// A move on an empty point is legal unless it is suicide: it has no empty
+// neighbor, captures nothing, and only connects to own chains in atari
+bool Board::isLegalIgnoringKo(Player p, int x, int y) {
+    const int n[4] = {index(x+1, y), index(x-1, y), index(x, y+1), index(x, y-1)};
+    for (int i = 0; i < 4; i++) {
+        Stone s = pieces[n[i]];
+        if (s == EMPTY)
+            return true;
+        if (s == -1)
+            continue;
+        bool atari = atariChains[s-1].find(chainID[n[i]]) != -1;
+        // Connecting to an own chain with another liberty, or capturing
+        if ((s == p) != atari)
+            return true;
     }
-
-    pieces[index(x, y)] = EMPTY;
-    return true;
+    return false;
 }
 
 /*
@@ -358,6 +437,7 @@ MoveList Board::getLegalMoves(Player p) {
 // Finds the pointer to the Chain struct with the given id, and returns the
 // index of that pointer in chainList.
 inline int Board::searchChainsByID(Chain *&node, int id) {
+    countStat(COUNT_CHAIN_LOOKUPS);
     for (unsigned int i = 0; i < chainList.size(); i++) {
         if (chainList.get(i)->id == id) {
             node = chainList.get(i);
@@ -410,6 +490,7 @@ void Board::mergeChains(Chain *node, int otherID, Move m) {
     }
 
     // Delete the chain "temp" now since it has been fully merged in
+    removeAtari(temp->color, temp->id);
     delete temp;
     chainList.removeFast(tempIndex);
 }
@@ -429,6 +510,7 @@ void Board::captureChain(Chain *node, int nodeIndex) {
         pieces[index(rx, ry)] = EMPTY;
         chainID[index(rx, ry)] = 0;
         zobristKey ^= zobristTable[zobristIndex(node->color, rx, ry)];
+        markDirty(node->squares[i]);
 
         // Add this square to adjacent chains' liberties
         int addID = chainID[index(rx+1, ry)];
@@ -437,8 +519,10 @@ void Board::captureChain(Chain *node, int nodeIndex) {
             Chain *temp = nullptr;
             searchChainsByID(temp, addID);
 
-            if (temp->findLiberty(coordToMove(rx, ry)) == -1)
+            if (temp->findLiberty(coordToMove(rx, ry)) == -1) {
                 temp->addLiberty(coordToMove(rx, ry));
+                updateAtari(temp);
+            }
         }
 
         addID = chainID[index(rx-1, ry)];
@@ -448,8 +532,10 @@ void Board::captureChain(Chain *node, int nodeIndex) {
             Chain *temp = nullptr;
             searchChainsByID(temp, addID);
 
-            if (temp->findLiberty(coordToMove(rx, ry)) == -1)
+            if (temp->findLiberty(coordToMove(rx, ry)) == -1) {
                 temp->addLiberty(coordToMove(rx, ry));
+                updateAtari(temp);
+            }
         }
 
         addID = chainID[index(rx, ry+1)];
@@ -460,8 +546,10 @@ void Board::captureChain(Chain *node, int nodeIndex) {
             Chain *temp = nullptr;
             searchChainsByID(temp, addID);
 
-            if (temp->findLiberty(coordToMove(rx, ry)) == -1)
+            if (temp->findLiberty(coordToMove(rx, ry)) == -1) {
                 temp->addLiberty(coordToMove(rx, ry));
+                updateAtari(temp);
+            }
         }
 
         addID = chainID[index(rx, ry-1)];
@@ -473,16 +561,83 @@ void Board::captureChain(Chain *node, int nodeIndex) {
             Chain *temp = nullptr;
             searchChainsByID(temp, addID);
 
-            if (temp->findLiberty(coordToMove(rx, ry)) == -1)
+            if (temp->findLiberty(coordToMove(rx, ry)) == -1) {
                 temp->addLiberty(coordToMove(rx, ry));
+                updateAtari(temp);
+            }
         }
     }
 
     // Remove this chain since it has been captured
+    removeAtari(node->color, node->id);
     delete node;
     chainList.removeFast(nodeIndex);
 }
 
+// Adds or removes a chain from the atari lists after its liberties changed
+void Board::updateAtari(Chain *node) {
+    int c = node->color - 1;
+    int i = atariChains[c].find(node->id);
+    if (node->liberties == 1) {
+        Move lib = node->libertyList[0];
+        if (i == -1) {
+            atariChains[c].add(node->id);
+            atariLiberties[c].add(lib);
+            markDirty(lib);
+        }
+        else if (atariLiberties[c].get(i) != lib) {
+            markDirty(atariLiberties[c].get(i));
+            atariLiberties[c].set(i, lib);
+            markDirty(lib);
+        }
+    }
+    else if (i != -1) {
+        markDirty(atariLiberties[c].get(i));
+        atariChains[c].removeFast(i);
+        atariLiberties[c].removeFast(i);
+    }
+}
+
+// Removes a chain that no longer exists from the atari lists
+void Board::removeAtari(Player color, int id) {
+    int i = atariChains[color-1].find(id);
+    if (i != -1) {
+        markDirty(atariLiberties[color-1].get(i));
+        atariChains[color-1].removeFast(i);
+        atariLiberties[color-1].removeFast(i);
+    }
+}
+
+// Records a point whose legality may have changed. If too many points are
+// recorded, all points are recomputed instead.
+inline void Board::markDirty(Move m) {
+    if (numDirty < 64)
+        dirtyPoints[numDirty] = m;
+    numDirty++;
+}
+
+void Board::updateLegality(int x, int y) {
+    int i = index(x, y);
+    for (Player p = BLACK; p <= WHITE; p++) {
+        bool legal = pieces[i] == EMPTY && !isEye(p, coordToMove(x, y))
+                  && isLegalIgnoringKo(p, x, y)
+                  && !getSettledOwner(coordToMove(x, y));
+        if (legal)
+            legalBits[p-1][i >> 6] |= (1ULL << (i & 63));
+        else
+            legalBits[p-1][i >> 6] &= ~(1ULL << (i & 63));
+    }
+}
+
+void Board::updateAllLegality() {
+    for (int c = 0; c < 2; c++)
+        for (int i = 0; i < 12; i++)
+            legalBits[c][i] = 0;
+    for (int j = 1; j <= boardSize; j++)
+        for (int i = 1; i <= boardSize; i++)
+            updateLegality(i, j);
+}
+
 // For debugging
 // Checks that the chains in chainList are consistent with the pieces and
 // chainID arrays
@@ -623,6 +778,9 @@ void Board::countTerritory(int &whiteTerritory, int &blackTerritory) {
                 // Only use empty squares as seeds
                 if (pieces[index(i, j)])
                     continue;
+                // Settled areas are counted separately below
+                if (getSettledOwner(coordToMove(i, j)))
+                    continue;
 
                 if (isEye(p, coordToMove(i, j))) {
                     visited[index(i, j)] = 1;
@@ -644,6 +802,15 @@ void Board::countTerritory(int &whiteTerritory, int &blackTerritory) {
                 if (territorySize + boundarySize == boardSize*boardSize)
                     continue;
 
+                // A region reaching into settled points contains the other
+                // side's pass-alive stones
+                bool reachesSettled = false;
+                for (int k = 0; k < arraySize*arraySize && !reachesSettled; k++)
+                    if (territory[k] && getSettledOwner(coordToMove(k % arraySize, k / arraySize)))
+                        reachesSettled = true;
+                if (reachesSettled)
+                    continue;
+
                 // Detect life/death of internal stones
                 // Initialize region to 0 if territory is 1, and vice versa
                 // This acts as our "visited" array, so that we only explore areas
@@ -701,6 +868,19 @@ void Board::countTerritory(int &whiteTerritory, int &blackTerritory) {
         }
     }
 
+    // Settled points are the owner's, including dead stones inside them
+    for (int j = 1; j <= boardSize; j++) {
+        for (int i = 1; i <= boardSize; i++) {
+            Player owner = getSettledOwner(coordToMove(i, j));
+            if (owner == EMPTY || pieces[index(i, j)] == owner)
+                continue;
+            if (owner == BLACK)
+                blackTerritory++;
+            else
+                whiteTerritory++;
+        }
+    }
+
     delete[] visited;
     delete[] territory;
     delete[] region;
@@ -762,12 +942,94 @@ bool Board::isInAtari(Move m) {
     int y = getY(m);
     assert(pieces[index(x, y)] != EMPTY);
 
-    Chain *node = nullptr;
-    searchChainsByID(node, chainID[index(x, y)]);
-    if (node->liberties == 1)
-        return true;
+    Player color = pieces[index(x, y)];
+    return atariChains[color-1].find(chainID[index(x, y)]) != -1;
+}
 
-    return false;
+// Returns true if playing move m as player p would leave the new chain with
+// at most one liberty. This is the same check as doMove() followed by
+// isInAtari(), but computed from the current position without a board copy.
+// Assumes that the move is valid.
+bool Board::isSelfAtari(Player p, Move m) {
+    if (m == MOVE_PASS)
+        return false;
+    int x = getX(m);
+    int y = getY(m);
+    assert(pieces[index(x, y)] == EMPTY);
+
+    Player victim = otherPlayer(p);
+    int adjX[4] = {x+1, x-1, x, x};
+    int adjY[4] = {y, y, y+1, y-1};
+    // IDs of own chains that the move connects to
+    int ownIDs[4];
+    int numOwn = 0;
+    // The first liberty found, as soon as we find a second we are done
+    Move liberty = MOVE_NULL;
+
+    for (int i = 0; i < 4; i++) {
+        Stone s = pieces[index(adjX[i], adjY[i])];
+        if (s == EMPTY) {
+            Move lib = coordToMove(adjX[i], adjY[i]);
+            if (liberty == MOVE_NULL)
+                liberty = lib;
+            else if (lib != liberty)
+                return false;
+        }
+        else if (s == p) {
+            int id = chainID[index(adjX[i], adjY[i])];
+            bool repeat = false;
+            for (int j = 0; j < numOwn; j++)
+                if (ownIDs[j] == id)
+                    repeat = true;
+            if (repeat)
+                continue;
+            ownIDs[numOwn] = id;
+            numOwn++;
+
+            Chain *node = nullptr;
+            searchChainsByID(node, id);
+            for (int j = 0; j < node->liberties; j++) {
+                Move lib = node->libertyList[j];
+                if (lib == m)
+                    continue;
+                if (liberty == MOVE_NULL)
+                    liberty = lib;
+                else if (lib != liberty)
+                    return false;
+            }
+        }
+    }
+
+    // Captured stones next to the new chain become liberties
+    for (int i = 0; i < 4; i++) {
+        if (pieces[index(adjX[i], adjY[i])] != victim)
+            continue;
+        Chain *node = nullptr;
+        searchChainsByID(node, chainID[index(adjX[i], adjY[i])]);
+        if (node->liberties != 1)
+            continue;
+
+        for (int j = 0; j < node->size; j++) {
+            int cx = getX(node->squares[j]);
+            int cy = getY(node->squares[j]);
+            bool adjacent = (std::abs(cx - x) + std::abs(cy - y) == 1);
+            for (int k = 0; k < numOwn && !adjacent; k++) {
+                adjacent = chainID[index(cx+1, cy)] == ownIDs[k]
+                        || chainID[index(cx-1, cy)] == ownIDs[k]
+                        || chainID[index(cx, cy+1)] == ownIDs[k]
+                        || chainID[index(cx, cy-1)] == ownIDs[k];
+            }
+            if (!adjacent)
+                continue;
+
+            if (liberty == MOVE_NULL)
+                liberty = node->squares[j];
+            else if (node->squares[j] != liberty)
+                return false;
+        }
+    }
+
+    return true;
 }
 
 // Given a square of the last move made, returns the move to capture
@@ -779,10 +1041,10 @@ Move Board::getPotentialCapture(Move m) {
     int y = getY(m);
     assert(pieces[index(x, y)] != EMPTY);
 
-    Chain *node = nullptr;
-    searchChainsByID(node, chainID[index(x, y)]);
-    if (node->liberties == 1)
-        return node->libertyList[0];
+    Player color = pieces[index(x, y)];
+    int i = atariChains[color-1].find(chainID[index(x, y)]);
+    if (i != -1)
+        return atariLiberties[color-1].get(i);
 
     return MOVE_PASS;
 }
@@ -790,149 +1052,55 @@ Move Board::getPotentialCapture(Move m) {
 // Given the square of the last move made, see if any chains of
 // player p have been put into atari and try to escape if possible
 Move Board::getPotentialEscape(Player p, Move m) {
-    if (m == MOVE_PASS)
+    if (m == MOVE_PASS || atariChains[p-1].size() == 0)
         return MOVE_PASS;
     int x = getX(m);
     int y = getY(m);
     assert(pieces[index(x, y)] != EMPTY);
 
-    if (pieces[index(x+1, y)] == p) {
-        Chain *node = nullptr;
-        searchChainsByID(node, chainID[index(x+1, y)]);
-        if (node->liberties == 1) {
-            Move esc = node->libertyList[0];
-            int ex = getX(esc);
-            int ey = getY(esc);
-            if (pieces[index(ex+1, ey)] == p && chainID[index(ex+1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex+1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex-1, ey)] == p && chainID[index(ex-1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex-1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey+1)] == p && chainID[index(ex, ey+1)] != node->id) {
+    const int dx[4] = {1, -1, 0, 0};
+    const int dy[4] = {0, 0, 1, -1};
+    for (int i = 0; i < 4; i++) {
+        if (pieces[index(x+dx[i], y+dy[i])] != p)
+            continue;
+        int id = chainID[index(x+dx[i], y+dy[i])];
+        int ai = atariChains[p-1].find(id);
+        if (ai == -1)
+            continue;
+
+        // Escaping works if the liberty connects to another chain with
+        // enough liberties
+        Move esc = atariLiberties[p-1].get(ai);
+        int ex = getX(esc);
+        int ey = getY(esc);
+        for (int j = 0; j < 4; j++) {
+            int ci = index(ex+dx[j], ey+dy[j]);
+            if (pieces[ci] == p && chainID[ci] != id) {
                 Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey+1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey-1)] == p && chainID[index(ex, ey-1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey-1)]);
+                searchChainsByID(conn, chainID[ci]);
                 if (conn->liberties > 2)
                     return esc;
             }
         }
     }
 
-    if (pieces[index(x-1, y)] == p) {
-        Chain *node = nullptr;
-        searchChainsByID(node, chainID[index(x-1, y)]);
-        if (node->liberties == 1) {
-            Move esc = node->libertyList[0];
-            int ex = getX(esc);
-            int ey = getY(esc);
-            if (pieces[index(ex+1, ey)] == p && chainID[index(ex+1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex+1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex-1, ey)] == p && chainID[index(ex-1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex-1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey+1)] == p && chainID[index(ex, ey+1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey+1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey-1)] == p && chainID[index(ex, ey-1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey-1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-        }
-    }
+    return MOVE_PASS;
+}
 
-    if (pieces[index(x, y+1)] == p) {
-        Chain *node = nullptr;
-        searchChainsByID(node, chainID[index(x, y+1)]);
-        if (node->liberties == 1) {
-            Move esc = node->libertyList[0];
-            int ex = getX(esc);
-            int ey = getY(esc);
-            if (pieces[index(ex+1, ey)] == p && chainID[index(ex+1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex+1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex-1, ey)] == p && chainID[index(ex-1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex-1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey+1)] == p && chainID[index(ex, ey+1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey+1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey-1)] == p && chainID[index(ex, ey-1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey-1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-        }
-    }
+// Returns the point where p may not play because of simple ko, or MOVE_NULL
+// if there is none
+Move Board::getKoPoint(Player p) {
+    return (p == koColor) ? koPoint : MOVE_NULL;
+}
 
-    if (pieces[index(x, y-1)] == p) {
-        Chain *node = nullptr;
-        searchChainsByID(node, chainID[index(x, y-1)]);
-        if (node->liberties == 1) {
-            Move esc = node->libertyList[0];
-            int ex = getX(esc);
-            int ey = getY(esc);
-            if (pieces[index(ex+1, ey)] == p && chainID[index(ex+1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex+1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex-1, ey)] == p && chainID[index(ex-1, ey)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex-1, ey)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey+1)] == p && chainID[index(ex, ey+1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey+1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-            if (pieces[index(ex, ey-1)] == p && chainID[index(ex, ey-1)] != node->id) {
-                Chain *conn = nullptr;
-                searchChainsByID(conn, chainID[index(ex, ey-1)]);
-                if (conn->liberties > 2)
-                    return esc;
-            }
-        }
-    }
+// Returns how many of p's chains are in atari
+int Board::getAtariCount(Player p) {
+    return atariChains[p-1].size();
+}
 
-    return MOVE_PASS;
+// Returns the last liberty of the i-th chain of p that is in atari
+Move Board::getAtariLiberty(Player p, int i) {
+    return atariLiberties[p-1].get(i);
 }
 
 MoveList Board::getLocalMoves(Move m) {
@@ -995,6 +1163,12 @@ int Board::getCapturedStones(Player p) {
     return (p == BLACK) ? blackCaptures : whiteCaptures;
 }
 
+// Returns how many more stones p has captured than the opponent
+int Board::getCaptureDifference(Player p) {
+    return (p == BLACK) ? blackCaptures - whiteCaptures
+                        : whiteCaptures - blackCaptures;
+}
+
 bool Board::isEmpty() {
     return (chainList.size() == 0);
 }
@@ -1004,6 +1178,294 @@ uint64_t Board::getZobristKey() {
     return zobristKey;
 }
 
+// Returns the Zobrist key of the position with the stones moved by the given
+// symmetry
+uint64_t Board::getSymmetricKey(int symmetry) {
+    uint64_t result = 0;
+    for (int j = 1; j <= boardSize; j++) {
+        for (int i = 1; i <= boardSize; i++) {
+            Stone s = pieces[index(i, j)];
+            if (s != BLACK && s != WHITE)
+                continue;
+            Move t = transformMove(coordToMove(i, j), symmetry);
+            result ^= zobristTable[zobristIndex(s, getX(t), getY(t))];
+        }
+    }
+    return result;
+}
+
+// Returns a bitmask of the symmetries that leave the position unchanged,
+// including the ko point. Bit 0, the identity, is always set.
+int Board::getSymmetries() {
+    int result = 1;
+    for (int t = 1; t < NUM_SYMMETRIES; t++) {
+        if (koPoint != MOVE_NULL && transformMove(koPoint, t) != koPoint)
+            continue;
+        if (getSymmetricKey(t) == zobristKey)
+            result |= (1 << t);
+    }
+    return result;
+}
+
+// Returns the Zobrist key of the position after player p plays move m,
+// including any captures, without making the move. Assumes that the move is
+// valid and not a suicide.
+uint64_t Board::getZobristKeyAfter(Player p, Move m) {
+    if (m == MOVE_PASS)
+        return zobristKey;
+    int x = getX(m);
+    int y = getY(m);
+    uint64_t result = zobristKey ^ zobristTable[zobristIndex(p, x, y)];
+
+    Player victim = otherPlayer(p);
+    int eastID = (pieces[index(x+1, y)] == victim) * chainID[index(x+1, y)];
+    int westID = (pieces[index(x-1, y)] == victim) * chainID[index(x-1, y)];
+    int northID = (pieces[index(x, y+1)] == victim) * chainID[index(x, y+1)];
+    int southID = (pieces[index(x, y-1)] == victim) * chainID[index(x, y-1)];
+    if (westID == eastID)
+        westID = 0;
+    if (northID == eastID || northID == westID)
+        northID = 0;
+    if (southID == eastID || southID == westID || southID == northID)
+        southID = 0;
+
+    int ids[4] = {eastID, westID, northID, southID};
+    for (int i = 0; i < 4; i++) {
+        if (!ids[i])
+            continue;
+        Chain *node = nullptr;
+        searchChainsByID(node, ids[i]);
+        if (node->liberties != 1)
+            continue;
+        for (int j = 0; j < node->size; j++) {
+            result ^= zobristTable[zobristIndex(victim,
+                getX(node->squares[j]), getY(node->squares[j]))];
+        }
+    }
+
+    return result;
+}
+
+
+
+//------------------------------------------------------------------------------
+//-------------------------Unconditional Life Detection-------------------------
+//------------------------------------------------------------------------------
+
+/*
+ * Finds the pass-alive chains of both colors with Benson's algorithm, and
+ * marks them and the regions they enclose as settled. Moves in settled points
+ * are no longer legal for playouts, and countTerritory() scores them
+ * directly. Pass-alive chains stay alive whatever the opponent plays, but not
+ * once their owner fills their eyes, so the settled points are found from
+ * scratch every time rather than only added to.
+ */
+void Board::updateSettled() {
+    uint64_t before[2][12];
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < 12; i++) {
+            before[c][i] = settledBits[c][i];
+            settledBits[c][i] = 0;
+        }
+    }
+
+    findPassAlive(BLACK);
+    findPassAlive(WHITE);
+
+    for (int j = 1; j <= boardSize; j++) {
+        for (int i = 1; i <= boardSize; i++) {
+            int k = index(i, j);
+            uint64_t changed = (before[0][k >> 6] ^ settledBits[0][k >> 6])
+                             | (before[1][k >> 6] ^ settledBits[1][k >> 6]);
+            if ((changed >> (k & 63)) & 1)
+                updateLegality(i, j);
+        }
+    }
+}
+
+// Returns the color that a point unconditionally belongs to, or EMPTY if it is
+// not settled
+Player Board::getSettledOwner(Move m) {
+    int i = index(getX(m), getY(m));
+    if ((settledBits[0][i >> 6] >> (i & 63)) & 1)
+        return BLACK;
+    if ((settledBits[1][i >> 6] >> (i & 63)) & 1)
+        return WHITE;
+    return EMPTY;
+}
+
+/*
+ * Benson's algorithm for player p. The board is split into p-enclosed
+ * regions, the connected areas of points without p's stones. A region is
+ * vital to a chain if all of the region's empty points are liberties of the
+ * chain. Starting from all of p's chains and all regions, chains with fewer
+ * than two vital regions are removed, then regions bordering a removed chain
+ * are removed, until nothing changes. The remaining chains are pass-alive.
+ */
+// Scratch space for findPassAlive(), which runs inside playouts. The board is
+// at most 27x27 with edges, but chain IDs are only bounded by the game length.
+struct PassAliveScratch {
+    int regionID[27*27];
+    // Up to four chains that every empty point of a region is next to
+    int vital[4*27*27];
+    int numVital[27*27];
+    bool hasEmpty[27*27];
+    bool regionOK[27*27];
+    Move stack[27*27];
+    // Whether each of p's chains, indexed by ID, is still a candidate
+    bool *alive;
+    int *vitalCount;
+    int idCapacity;
+};
+
+static thread_local PassAliveScratch passAlive;
+
+void Board::findPassAlive(Player p) {
+    int points = arraySize * arraySize;
+    PassAliveScratch &sc = passAlive;
+    if (sc.idCapacity < nextID) {
+        delete[] sc.alive;
+        delete[] sc.vitalCount;
+        sc.idCapacity = 2 * nextID;
+        sc.alive = new bool[sc.idCapacity];
+        sc.vitalCount = new int[sc.idCapacity];
+    }
+    int *regionID = sc.regionID;
+    int *vital = sc.vital;
+    int *numVital = sc.numVital;
+    bool *hasEmpty = sc.hasEmpty;
+    bool *regionOK = sc.regionOK;
+    bool *alive = sc.alive;
+    int *vitalCount = sc.vitalCount;
+    Move *stack = sc.stack;
+    int numRegions = 0;
+
+    for (int i = 0; i < points; i++)
+        regionID[i] = -1;
+    for (int i = 0; i < nextID; i++)
+        alive[i] = false;
+    for (unsigned int i = 0; i < chainList.size(); i++)
+        if (chainList.get(i)->color == p)
+            alive[chainList.get(i)->id] = true;
+
+    // Label the regions and find the chains each one is vital to
+    for (int j = 1; j <= boardSize; j++) {
+        for (int i = 1; i <= boardSize; i++) {
+            if (pieces[index(i, j)] == p || regionID[index(i, j)] != -1)
+                continue;
+
+            int r = numRegions++;
+            numVital[r] = 0;
+            hasEmpty[r] = false;
+            regionOK[r] = true;
+            int top = 0;
+            stack[top++] = coordToMove(i, j);
+            regionID[index(i, j)] = r;
+
+            while (top > 0) {
+                Move m = stack[--top];
+                int x = getX(m);
+                int y = getY(m);
+                const int n[4] = {index(x+1, y), index(x-1, y),
+                                  index(x, y+1), index(x, y-1)};
+
+                if (pieces[index(x, y)] == EMPTY) {
+                    // Intersect the vital chains with this point's chains
+                    int adjacent[4];
+                    int numAdjacent = 0;
+                    for (int d = 0; d < 4; d++)
+                        if (pieces[n[d]] == p)
+                            adjacent[numAdjacent++] = chainID[n[d]];
+                    if (!hasEmpty[r]) {
+                        for (int d = 0; d < numAdjacent; d++) {
+                            bool repeat = false;
+                            for (int e = 0; e < numVital[r]; e++)
+                                if (vital[4*r + e] == adjacent[d])
+                                    repeat = true;
+                            if (!repeat)
+                                vital[4*r + numVital[r]++] = adjacent[d];
+                        }
+                        hasEmpty[r] = true;
+                    }
+                    else {
+                        int kept = 0;
+                        for (int e = 0; e < numVital[r]; e++) {
+                            for (int d = 0; d < numAdjacent; d++) {
+                                if (vital[4*r + e] == adjacent[d]) {
+                                    vital[4*r + kept++] = vital[4*r + e];
+                                    break;
+                                }
+                            }
+                        }
+                        numVital[r] = kept;
+                    }
+                }
+
+                for (int d = 0; d < 4; d++) {
+                    if (pieces[n[d]] == p || pieces[n[d]] == -1
+                     || regionID[n[d]] != -1)
+                        continue;
+                    regionID[n[d]] = r;
+                    stack[top++] = coordToMove(n[d] % arraySize, n[d] / arraySize);
+                }
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // Remove chains with fewer than two vital regions
+        for (int i = 0; i < nextID; i++)
+            vitalCount[i] = 0;
+        for (int r = 0; r < numRegions; r++) {
+            if (!regionOK[r] || !hasEmpty[r])
+                continue;
+            for (int e = 0; e < numVital[r]; e++)
+                vitalCount[vital[4*r + e]]++;
+        }
+        for (int i = 0; i < nextID; i++) {
+            if (alive[i] && vitalCount[i] < 2) {
+                alive[i] = false;
+                changed = true;
+            }
+        }
+
+        // Remove regions next to removed chains
+        for (int j = 1; j <= boardSize; j++) {
+            for (int i = 1; i <= boardSize; i++) {
+                int k = index(i, j);
+                if (pieces[k] != p || alive[chainID[k]])
+                    continue;
+                const int n[4] = {k+1, k-1, k+arraySize, k-arraySize};
+                for (int d = 0; d < 4; d++) {
+                    int r = regionID[n[d]];
+                    if (r != -1 && regionOK[r]) {
+                        regionOK[r] = false;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Mark the pass-alive chains, and the regions vital to them
+    for (int j = 1; j <= boardSize; j++) {
+        for (int i = 1; i <= boardSize; i++) {
+            int k = index(i, j);
+            bool settled;
+            if (pieces[k] == p)
+                settled = alive[chainID[k]];
+            else {
+                int r = regionID[k];
+                settled = regionOK[r] && hasEmpty[r] && numVital[r] > 0;
+            }
+            if (settled)
+                settledBits[p-1][k >> 6] |= (1ULL << (k & 63));
+        }
+    }
+}
 
 
 //------------------------------------------------------------------------------
@@ -1028,10 +1490,18 @@ void Board::init() {
     blackCaptures = 0;
     whiteCaptures = 0;
     zobristKey = 0;
+    koPoint = MOVE_NULL;
+    koColor = EMPTY;
     nextID = 1;
     chainID = new int[arraySize*arraySize];
     for (int i = 0; i < arraySize*arraySize; i++)
         chainID[i] = 0;
+
+    for (int c = 0; c < 2; c++)
+        for (int i = 0; i < 12; i++)
+            settledBits[c][i] = 0;
+    numDirty = 0;
+    updateAllLegality();
 }
 
 void Board::deinit() {
@@ -1041,6 +1511,11 @@ void Board::deinit() {
     for (unsigned int i = 0; i < chainList.size(); i++)
         delete chainList.get(i);
     chainList.clear();
+
+    for (int c = 0; c < 2; c++) {
+        atariChains[c].clear();
+        atariLiberties[c].clear();
+    }
 }
 
 // Resets a board object completely.
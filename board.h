@@ -4,29 +4,55 @@
 #include "chain.h"
 #include "types.h"
 
+extern int arraySize;
+
+// An upper bound on one color's chains in atari on a 21 x 21 board. Each such
+// chain has one liberty, shared by at most 4 chains, and its other neighbors
+// are edges or opposing stones, each touching at most 4 chains. Counting
+// points gives at most 231.
+const int MAX_ATARI_CHAINS = 256;
+
 void initZobristTable();
 
+// The 8 symmetries of the board: bit 0 mirrors x, bit 1 mirrors y, and bit 2
+// swaps x and y. Symmetry 0 is the identity.
+const int NUM_SYMMETRIES = 8;
+Move transformMove(Move m, int symmetry);
+
 class Board {
 public:
     Board();
     Board(const Board &other);
     ~Board();
+    Board& operator=(const Board &other);
 
     void doMove(Player p, Move m);
     bool isMoveValid(Player p, Move m);
+    bool isLegalNonEye(Player p, Move m);
     MoveList getLegalMoves(Player p);
 
     void countTerritory(int &whiteTerritory, int &blackTerritory);
+    void updateSettled();
+    Player getSettledOwner(Move m);
     bool isEye(Player p, Move m);
     bool isInAtari(Move m);
+    bool isSelfAtari(Player p, Move m);
+    Move getKoPoint(Player p);
     Move getPotentialCapture(Move m);
     Move getPotentialEscape(Player p, Move m);
+    int getAtariCount(Player p);
+    Move getAtariLiberty(Player p, int i);
     MoveList getLocalMoves(Move m);
 
     int getCapturedStones(Player p);
+    int getCaptureDifference(Player p);
+    Stone getStone(int x, int y) { return pieces[x + y * arraySize]; }
     bool isEmpty();
 
     uint64_t getZobristKey();
+    uint64_t getZobristKeyAfter(Player p, Move m);
+    uint64_t getSymmetricKey(int symmetry);
+    int getSymmetries();
 
     void reset();
     void prettyPrint();
@@ -36,17 +62,40 @@ private:
     Stone *pieces;
     int blackCaptures, whiteCaptures;
     uint64_t zobristKey;
+    // The point where koColor may not play because of simple ko, or
+    // MOVE_NULL if there is none
+    Move koPoint;
+    Player koColor;
     int nextID;
     int *chainID;
     GoArrayList<Chain *> chainList;
+    // The IDs of each color's chains in atari, and their last liberties
+    GoArrayList<int, MAX_ATARI_CHAINS> atariChains[2];
+    GoArrayList<Move, MAX_ATARI_CHAINS> atariLiberties[2];
+    // For each color, one bit per point that is empty, not an own eye, not
+    // suicide and not settled. Simple ko is checked separately.
+    uint64_t legalBits[2][12];
+    // For each color, one bit per point that is unconditionally that color's:
+    // pass-alive stones and the regions they enclose, as of the last call to
+    // updateSettled().
+    uint64_t settledBits[2][12];
+    // Points whose legality must be recomputed at the end of doMove()
+    Move dirtyPoints[64];
+    int numDirty;
 
-    Board& operator=(const Board &other);
+    void copy(const Board &other);
 
     // Chain update helpers
     int searchChainsByID(Chain *&node, int id);
     void updateLiberty(Chain *node, int x, int y);
     void mergeChains(Chain *node, int otherID, Move m);
     void captureChain(Chain *node, int nodeIndex);
+    void updateAtari(Chain *node);
+    void removeAtari(Player color, int id);
+    void markDirty(Move m);
+    bool isLegalIgnoringKo(Player p, int x, int y);
+    void updateLegality(int x, int y);
+    void updateAllLegality();
 
     bool checkChains();
 
@@ -56,6 +105,7 @@ private:
         Stone *visited, MoveList &captured);
     void getTerritory(Player blocker, int x, int y, Stone *visited,
         Stone *territory, int &territorySize, int &boundarySize);
+    void findPassAlive(Player p);
 
     void init();
     void deinit();
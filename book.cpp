@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "book.h"
+
+extern int boardSize;
+extern float komi;
+
+static const char BOOK_MAGIC[8] = {'G', 'O', 'B', 'O', 'O', 'K', '2', '\0'};
+
+// The mapped book, if one is loaded
+static void *bookData = NULL;
+static size_t bookSize = 0;
+static const BookEntry *bookEntries = NULL;
+static uint32_t bookCount = 0;
+
+
+// The symmetry that undoes the given one. Mirrors are their own inverses, and
+// after a swap of x and y, the mirrors of x and y trade places.
+static int inverseSymmetry(int symmetry) {
+    if (!(symmetry & 4))
+        return symmetry;
+    return 4 | ((symmetry & 1) << 1) | ((symmetry & 2) >> 1);
+}
+
+// Returns the book key of a position played at the given komi, and sets
+// symmetry to the transform that takes the position to its canonical
+// orientation
+uint64_t getBookKey(Board &b, Player p, float komi, int &symmetry) {
+    uint64_t key = b.getSymmetricKey(0);
+    symmetry = 0;
+    for (int t = 1; t < NUM_SYMMETRIES; t++) {
+        uint64_t k = b.getSymmetricKey(t);
+        if (k < key) {
+            key = k;
+            symmetry = t;
+        }
+    }
+    key ^= 0x9E3779B97F4A7C15ULL * boardSize;
+    if (p == WHITE)
+        key ^= 0xC2B2AE3D27D4EB4FULL;
+    Move ko = b.getKoPoint(p);
+    if (ko != MOVE_NULL)
+        key ^= 0xD6E8FEB86659FD93ULL * (transformMove(ko, symmetry) + 1);
+    key ^= 0xFF51AFD7ED558CCDULL * (uint64_t) (int64_t) (2 * komi);
+    return key;
+}
+
+
+//------------------------------------------------------------------------------
+//---------------------------------Lookup---------------------------------------
+//------------------------------------------------------------------------------
+// Maps a book file, replacing any book already loaded. Returns false if the
+// file can't be read or is not a book.
+bool loadBook(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t) sizeof(BookHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const BookHeader *header = (const BookHeader *) data;
+    if (memcmp(header->magic, BOOK_MAGIC, sizeof(BOOK_MAGIC)) != 0
+     || sizeof(BookHeader) + (size_t) header->count * sizeof(BookEntry)
+            > (size_t) info.st_size) {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    unloadBook();
+    bookData = data;
+    bookSize = info.st_size;
+    bookEntries = (const BookEntry *) ((const char *) data + sizeof(BookHeader));
+    bookCount = header->count;
+    return true;
+}
+
+void unloadBook() {
+    if (bookData != NULL)
+        munmap(bookData, bookSize);
+    bookData = NULL;
+    bookSize = 0;
+    bookEntries = NULL;
+    bookCount = 0;
+}
+
+// Returns a move from the book for p, chosen at random in proportion to how
+// often it was played, or MOVE_NULL if the position is not in the book. The
+// move is only checked to be on an empty point: the caller checks the rest.
+Move probeBook(Board &b, Player p, Rng &rng) {
+    if (bookCount == 0)
+        return MOVE_NULL;
+
+    int symmetry;
+    uint64_t key = getBookKey(b, p, komi, symmetry);
+    const BookEntry *first = bookEntries;
+    const BookEntry *last = bookEntries + bookCount;
+    while (first < last) {
+        const BookEntry *mid = first + (last - first) / 2;
+        if (mid->key < key)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+
+    uint64_t total = 0;
+    const BookEntry *end = first;
+    for (; end < bookEntries + bookCount && end->key == key; end++)
+        total += end->weight;
+    if (total == 0)
+        return MOVE_NULL;
+
+    uint64_t choice = rng.next() % total;
+    const BookEntry *entry = first;
+    while (choice >= entry->weight) {
+        choice -= entry->weight;
+        entry++;
+    }
+
+    Move m = transformMove(entry->move, inverseSymmetry(symmetry));
+    if (m != MOVE_PASS && b.getStone(getX(m), getY(m)) != EMPTY)
+        return MOVE_NULL;
+    return m;
+}
+
+
+//------------------------------------------------------------------------------
+//--------------------------------Building--------------------------------------
+//------------------------------------------------------------------------------
+// Counts one play of m by p in the position on b, in a game at the given komi
+void BookBuilder::add(Board &b, Player p, Move m, float komi) {
+    int symmetry;
+    uint64_t key = getBookKey(b, p, komi, symmetry);
+    counts[key][transformMove(m, symmetry)]++;
+}
+
+// Writes the moves played at least minWeight times to a book file. Returns
+// the number of entries written, or -1 if the file can't be written.
+int BookBuilder::write(const std::string &filename, uint32_t minWeight) {
+    std::vector<BookEntry> entries;
+    for (auto position = counts.begin(); position != counts.end(); position++) {
+        for (auto move = position->second.begin();
+                move != position->second.end(); move++) {
+            if (move->second < minWeight)
+                continue;
+            BookEntry entry;
+            entry.key = position->first;
+            entry.move = move->first;
+            entry.reserved = 0;
+            entry.weight = move->second;
+            entries.push_back(entry);
+        }
+    }
+    // Within a position, the most played moves come first
+    std::sort(entries.begin(), entries.end(),
+        [](const BookEntry &a, const BookEntry &b) {
+            return (a.key != b.key) ? (a.key < b.key) : (a.weight > b.weight);
+        });
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == NULL)
+        return -1;
+    BookHeader header;
+    memcpy(header.magic, BOOK_MAGIC, sizeof(BOOK_MAGIC));
+    header.count = entries.size();
+    header.reserved = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(entries.data(), sizeof(BookEntry), entries.size(), file)
+            == entries.size();
+    ok = (fclose(file) == 0) && ok;
+    return ok ? (int) entries.size() : -1;
+}
@@ -0,0 +1,51 @@
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include <string>
+#include <unordered_map>
+#include "board.h"
+#include "rng.h"
+#include "types.h"
+
+/*
+ * An opening book. The file is a header followed by entries sorted by
+ * position key, one entry per move seen in a position, and is memory mapped
+ * read-only, so that every engine process on a machine shares one copy.
+ *
+ * Positions are keyed by the smallest of their eight symmetric Zobrist keys,
+ * mixed with the board size, the side to move, the ko point and the komi, and
+ * moves are stored in that canonical orientation. A lookup is a binary search.
+ * A book built from games at another komi simply has no moves to offer.
+ */
+struct BookHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct BookEntry {
+    uint64_t key;
+    uint16_t move;
+    uint16_t reserved;
+    // How often the move was played, among the games the book was built from
+    uint32_t weight;
+};
+
+uint64_t getBookKey(Board &b, Player p, float komi, int &symmetry);
+bool loadBook(const std::string &filename);
+void unloadBook();
+Move probeBook(Board &b, Player p, Rng &rng);
+
+// Counts the moves played in a collection of games, and writes them out as a
+// book file
+class BookBuilder {
+public:
+    void add(Board &b, Player p, Move m, float komi);
+    int write(const std::string &filename, uint32_t minWeight);
+
+private:
+    // Move counts for each position key
+    std::unordered_map<uint64_t, std::unordered_map<uint16_t, uint32_t>> counts;
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "evaluator.h"
+#include "search.h"
+
+
+extern int boardSize;
+extern float komi;
+extern int mercyThreshold;
+
+
+//------------------------------------------------------------------------------
+//-----------------------------Rollout Evaluator--------------------------------
+//------------------------------------------------------------------------------
+void RolloutEvaluator::evaluate(EvalRequest *batch, int n, Rng &rng) {
+    for (int i = 0; i < n; i++) {
+        EvalRequest &req = batch[i];
+
+        // Play out a random game. The final board state is stored in the board,
+        // and its moves are remembered for the last good reply policy.
+        Player mercyWinner = playRandomGame(req.toMove, *(req.board), rng);
+        Player mover = otherPlayer(req.toMove);
+
+        // The playout was stopped early by the mercy rule, and the side ahead
+        // wins whatever komi and the bias. The capture lead stands in for the
+        // score.
+        if (mercyWinner != EMPTY) {
+            float lead = req.board->getCaptureDifference(mover);
+            req.score = (mover == BLACK) ? lead - komi : lead + komi;
+            req.value = (mercyWinner == mover) ? 1.0 : 0.0;
+            updateLastGoodReplies(mercyWinner);
+            continue;
+        }
+
+        float myScore = 0.0, oppScore = 0.0;
+        scoreGame(mover, *(req.board), myScore, oppScore);
+        req.score = myScore - oppScore;
+        req.value = (myScore - req.bias > oppScore) ? 1.0 : 0.0;
+        updateLastGoodReplies((myScore > oppScore) ? mover : req.toMove);
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//----------------------------Lockstep Evaluator--------------------------------
+//------------------------------------------------------------------------------
+void LockstepEvaluator::evaluate(EvalRequest *batch, int n, Rng &rng) {
+    Board *boards[LOCKSTEP_LANES];
+    Player toMove[LOCKSTEP_LANES];
+    int blackLead[LOCKSTEP_LANES];
+    Player mercyWinner[LOCKSTEP_LANES];
+
+    for (int first = 0; first < n; first += LOCKSTEP_LANES) {
+        int count = std::min(LOCKSTEP_LANES, n - first);
+        for (int i = 0; i < count; i++) {
+            boards[i] = batch[first + i].board;
+            toMove[i] = batch[first + i].toMove;
+        }
+        playLockstepGames(boards, toMove, count, rng, mercyThreshold,
+            blackLead, mercyWinner);
+
+        for (int i = 0; i < count; i++) {
+            EvalRequest &req = batch[first + i];
+            Player mover = otherPlayer(req.toMove);
+            float lead = (mover == BLACK) ? blackLead[i] - komi
+                                          : komi - blackLead[i];
+            req.score = lead;
+            if (mercyWinner[i] != EMPTY)
+                req.value = (mercyWinner[i] == mover) ? 1.0 : 0.0;
+            else
+                req.value = (lead - req.bias > 0) ? 1.0 : 0.0;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//----------------------------Conv Net Evaluator--------------------------------
+//------------------------------------------------------------------------------
+const int INPUT_PLANES = 3;
+
+// out[i][j] = bias[j] + sum_k a[i][k] * b[k][j]
+// The inner loop runs over contiguous memory so that the compiler vectorizes
+// it. Zero inputs, which are common since the input planes are sparse and
+// im2col pads with zeros, are skipped.
+static void gemm(const float * __restrict__ a, const float * __restrict__ b,
+    const float * __restrict__ bias, float * __restrict__ out,
+    int rows, int inner, int cols) {
+    for (int i = 0; i < rows; i++) {
+        float *row = out + i * cols;
+        for (int j = 0; j < cols; j++)
+            row[j] = bias[j];
+        for (int k = 0; k < inner; k++) {
+            float aik = a[i * inner + k];
+            if (aik == 0.0f)
+                continue;
+            const float *brow = b + k * cols;
+            for (int j = 0; j < cols; j++)
+                row[j] += aik * brow[j];
+        }
+    }
+}
+
+// Expands each 3x3 neighborhood of a [points][planes] input into a row of
+// [planes*9] values so that a convolution becomes a single GEMM.
+static void im2col(const float *in, float *col, int planes) {
+    for (int y = 0; y < boardSize; y++) {
+        for (int x = 0; x < boardSize; x++) {
+            float *row = col + (x + y * boardSize) * planes * 9;
+            for (int c = 0; c < planes; c++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx;
+                        int ny = y + dy;
+                        float v = 0.0f;
+                        if (nx >= 0 && nx < boardSize && ny >= 0 && ny < boardSize)
+                            v = in[(nx + ny * boardSize) * planes + c];
+                        row[c * 9 + (dy+1) * 3 + (dx+1)] = v;
+                    }
+                }
+            }
+        }
+    }
+}
+
+ConvNetEvaluator::ConvNetEvaluator() {
+    channels = 0;
+    layers = 0;
+    headBias = 0.0;
+}
+
+// Loads network weights from a file. Returns false, and leaves the network
+// unloaded, if the file is missing or malformed.
+bool ConvNetEvaluator::load(const std::string &filename) {
+    std::ifstream in(filename.c_str());
+    int c = 0, l = 0;
+    if (!(in >> c >> l) || c <= 0 || l <= 0)
+        return false;
+
+    std::vector<std::vector<float> > w(l), b(l);
+    for (int i = 0; i < l; i++) {
+        int inPlanes = (i == 0) ? INPUT_PLANES : c;
+        w[i].resize(inPlanes * 9 * c);
+        b[i].resize(c);
+        // The file stores [out][in][3][3]; transpose into [in][3][3][out]
+        for (int o = 0; o < c; o++)
+            for (int k = 0; k < inPlanes * 9; k++)
+                if (!(in >> w[i][k * c + o]))
+                    return false;
+        for (int o = 0; o < c; o++)
+            if (!(in >> b[i][o]))
+                return false;
+    }
+
+    std::vector<float> hw(c);
+    float hb;
+    for (int o = 0; o < c; o++)
+        if (!(in >> hw[o]))
+            return false;
+    if (!(in >> hb))
+        return false;
+
+    channels = c;
+    layers = l;
+    convWeights.swap(w);
+    convBiases.swap(b);
+    headWeights.swap(hw);
+    headBias = hb;
+    return true;
+}
+
+void ConvNetEvaluator::evaluate(EvalRequest *batch, int n, Rng &rng) {
+    int points = boardSize * boardSize;
+    int maxPlanes = (channels > INPUT_PLANES) ? channels : INPUT_PLANES;
+    std::vector<float> act(n * points * maxPlanes);
+    std::vector<float> col(n * points * maxPlanes * 9);
+    std::vector<float> out(n * points * channels);
+
+    // Fill the input planes
+    for (int i = 0; i < n; i++) {
+        Player me = batch[i].toMove;
+        float *planes = &act[i * points * INPUT_PLANES];
+        for (int y = 1; y <= boardSize; y++) {
+            for (int x = 1; x <= boardSize; x++) {
+                Stone s = batch[i].board->getStone(x, y);
+                float *pt = planes + ((x-1) + (y-1) * boardSize) * INPUT_PLANES;
+                pt[0] = (s == me);
+                pt[1] = (s == otherPlayer(me));
+                pt[2] = 1.0f;
+            }
+        }
+    }
+
+    // The convolutional tower. All positions in the batch go through a
+    // single GEMM per layer.
+    int planes = INPUT_PLANES;
+    for (int l = 0; l < layers; l++) {
+        for (int i = 0; i < n; i++) {
+            im2col(&act[i * points * planes],
+                   &col[i * points * planes * 9], planes);
+        }
+        gemm(&col[0], &convWeights[l][0], &convBiases[l][0], &out[0],
+             n * points, planes * 9, channels);
+        for (int k = 0; k < n * points * channels; k++)
+            act[k] = (out[k] > 0.0f) ? out[k] : 0.0f;
+        planes = channels;
+    }
+
+    // Value head: global average pool, then a sigmoid unit
+    for (int i = 0; i < n; i++) {
+        float sum = headBias;
+        const float *a = &act[i * points * planes];
+        for (int c = 0; c < planes; c++) {
+            float avg = 0.0f;
+            for (int k = 0; k < points; k++)
+                avg += a[k * planes + c];
+            sum += headWeights[c] * avg / points;
+        }
+        // The output is for the player to move, and requests are answered
+        // for the player who moved into the leaf
+        float toMoveWins = 1.0f / (1.0f + std::exp(-sum));
+        batch[i].value = 1.0f - toMoveWins;
+        batch[i].score = 0.0;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+//-----------------------------Mixed Evaluator----------------------------------
+//------------------------------------------------------------------------------
+MixedEvaluator::MixedEvaluator(Evaluator *_first, Evaluator *_second,
+    float _weight) {
+    first = _first;
+    second = _second;
+    weight = _weight;
+}
+
+void MixedEvaluator::evaluate(EvalRequest *batch, int n, Rng &rng) {
+    if (weight <= 0.0) {
+        first->evaluate(batch, n, rng);
+        return;
+    }
+
+    second->evaluate(batch, n, rng);
+    if (weight >= 1.0)
+        return;
+
+    float *secondValues = new float[n];
+    for (int i = 0; i < n; i++)
+        secondValues[i] = batch[i].value;
+
+    first->evaluate(batch, n, rng);
+    for (int i = 0; i < n; i++) {
+        batch[i].value = (1.0 - weight) * batch[i].value
+                       + weight * secondValues[i];
+    }
+
+    delete[] secondValues;
+}
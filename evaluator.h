@@ -0,0 +1,108 @@
+#ifndef __EVALUATOR_H__
+#define __EVALUATOR_H__
+
+#include <string>
+#include <vector>
+#include "board.h"
+#include "lockstep.h"
+#include "rng.h"
+#include "types.h"
+
+/*
+ * A leaf position queued by the search for evaluation.
+ */
+struct EvalRequest {
+    // The position to evaluate, with toMove to play. Evaluators are allowed
+    // to modify the board.
+    Board *board;
+    Player toMove;
+    // A score handicap for the player who moved into the leaf. This is only
+    // used by evaluators that compute exact scores.
+    float bias;
+
+    // Results, from the point of view of the player who moved into the leaf:
+    // the probability of winning and the expected score difference.
+    float value;
+    float score;
+};
+
+/*
+ * The interface between the search and whatever evaluates its leaves. The
+ * search queues up to batchSize() leaves, keeping other descents away from
+ * them with virtual loss, and then hands the whole batch to evaluate().
+ */
+class Evaluator {
+public:
+    virtual ~Evaluator() {}
+
+    virtual int batchSize() = 0;
+    virtual void evaluate(EvalRequest *batch, int n, Rng &rng) = 0;
+};
+
+// Plays a random game to the end and scores it. There is no gain from
+// batching, so leaves are evaluated one at a time.
+class RolloutEvaluator : public Evaluator {
+public:
+    int batchSize() { return 1; }
+    void evaluate(EvalRequest *batch, int n, Rng &rng);
+};
+
+// Plays random games for a whole batch at once with the lockstep playout
+// engine. The boards are not modified.
+class LockstepEvaluator : public Evaluator {
+public:
+    int batchSize() { return LOCKSTEP_LANES; }
+    void evaluate(EvalRequest *batch, int n, Rng &rng);
+};
+
+/*
+ * A small value network: a stack of 3x3 convolutions with ReLU, then a global
+ * average pool and a single sigmoid output. The convolutions of a whole batch
+ * are done as one matrix multiply (im2col + GEMM).
+ *
+ * The weights file is whitespace separated text: the number of channels and
+ * the number of convolution layers, then for each layer the weights in
+ * [out][in][3][3] order followed by the biases, and finally the value head
+ * weights and bias. The input planes are the stones of the player to move,
+ * the opponent's stones, and a plane of ones.
+ */
+class ConvNetEvaluator : public Evaluator {
+public:
+    ConvNetEvaluator();
+
+    bool load(const std::string &filename);
+    bool isLoaded() { return layers > 0; }
+
+    int batchSize() { return 8; }
+    void evaluate(EvalRequest *batch, int n, Rng &rng);
+
+private:
+    int channels;
+    int layers;
+    // Per-layer weights, stored transposed as [in*9][out] for the GEMM
+    std::vector<std::vector<float> > convWeights;
+    std::vector<std::vector<float> > convBiases;
+    std::vector<float> headWeights;
+    float headBias;
+};
+
+// Blends the values of two evaluators. Only the first evaluator's score is
+// used. The second evaluator runs first, so it sees the unmodified board.
+class MixedEvaluator : public Evaluator {
+public:
+    MixedEvaluator(Evaluator *_first, Evaluator *_second, float _weight);
+
+    int batchSize() { return second->batchSize(); }
+    void evaluate(EvalRequest *batch, int n, Rng &rng);
+
+    void setFirst(Evaluator *_first) { first = _first; }
+
+    // The weight given to the second evaluator, from 0 to 1
+    float weight;
+
+private:
+    Evaluator *first;
+    Evaluator *second;
+};
+
+#endif
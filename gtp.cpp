@@ -1,51 +1,145 @@
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <vector>
+#include "benchmark.h"
 #include "board.h"
+#include "book.h"
 #include "gtp.h"
+#include "patterns.h"
 #include "search.h"
+#include "sgf.h"
+#include "solver.h"
+#include "stats.h"
 
 
 Player stringToColor(string colorString);
 vector<string> split(const string &s, char d);
+string moveToString(Move m);
+void readCommands();
+string nextCommand();
+void beginInterruptible();
+void endInterruptible();
+void printAnalysis(const vector<AnalysisMove> &moves);
 
 
 Move lastMove = MOVE_PASS;
 bool debugOutput = false;
+// If set, the search cache is loaded from here at startup and saved on quit
+string cacheFile;
+
+// Lines read from stdin that have not been executed yet. Reading is done on
+// its own thread, so that commands can interrupt a running search.
+deque<string> commandQueue;
+mutex commandMutex;
+condition_variable commandReady;
+// Set while running a command that searches until it is interrupted. The
+// next command read then stops the search, and clears this. Otherwise,
+// commands are queued behind the search in progress, as GTP expects, and only
+// stop interrupts it. Quit and the end of input wait for the commands queued
+// before them to finish, so piped scripts get fully searched moves.
+atomic<bool> searchInterruptible(false);
+
+// Analysis keeps its response open until interrupted, but the tree is not
+// allowed to grow without bound
+const int MAX_ANALYSIS_PLAYOUTS = 100000;
 
 
 int main(int argc, char **argv) {
+    // Do necessary initializations
+    initZobristTable();
+    initPatterns();
+
     // Parse command line arguments and flags with little error checking...
-    if (argc == 2) {
-        if (argv[1][0] == '-') {
-            debugOutput = true;
+    bool benchmarkOnly = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg == "--seed" && i+1 < argc) {
+            i++;
+            setSearchSeed(stoull(string(argv[i])));
         }
-        else {
-            playouts = stoi(string(argv[1]));
+        else if (arg == "--mercy" && i+1 < argc) {
+            i++;
+            int threshold = stoi(string(argv[i]));
+            if (threshold < 0)
+                cerr << "Mercy threshold must not be negative" << endl;
+            else
+                setMercyThreshold(threshold);
         }
-    }
-    else if (argc == 3) {
-        debugOutput = true;
-
-        if (argv[1][0] != '-') {
-            playouts = stoi(string(argv[1]));
+        else if (arg == "--policy" && i+1 < argc) {
+            i++;
+            string policy = string(argv[i]);
+            if (policy == "random" || policy == "pattern"
+             || policy == "lockstep") {
+                setPatternPlayouts(policy == "pattern");
+                setLockstepPlayouts(policy == "lockstep");
+            }
+            else
+                cerr << "Unknown playout policy " << policy << endl;
+        }
+        else if (arg == "--patterns" && i+1 < argc) {
+            i++;
+            if (loadPatterns(string(argv[i])))
+                setPatternPlayouts(true);
+            else
+                cerr << "Could not load patterns from " << argv[i] << endl;
+        }
+        else if (arg == "--ladders") {
+            setPlayoutLadders(true);
+        }
+        else if (arg == "--replies") {
+            setLastGoodReply(true);
+        }
+        else if (arg == "--book" && i+1 < argc) {
+            i++;
+            if (!loadBook(string(argv[i])))
+                cerr << "Could not load book from " << argv[i] << endl;
+        }
+        else if (arg == "--cache" && i+1 < argc) {
+            // The file may not exist yet, on the first run
+            i++;
+            cacheFile = string(argv[i]);
+            loadSearchCache(cacheFile);
+        }
+        else if (arg == "--weights" && i+1 < argc) {
+            i++;
+            if (!loadNetWeights(string(argv[i])))
+                cerr << "Could not load weights from " << argv[i] << endl;
+        }
+        else if (arg == "--stats") {
+            setStatsEnabled(true);
+        }
+        else if (arg == "--bench") {
+            benchmarkOnly = true;
+        }
+        else if (arg[0] == '-') {
+            debugOutput = true;
         }
         else {
-            playouts = stoi(string(argv[2]));
+            playouts = stoi(arg);
         }
     }
 
-    // Do necessary initializations
-    initZobristTable();
+    // Run the benchmark with the other settings given, and exit
+    if (benchmarkOnly) {
+        runBenchmark(cout);
+        return 0;
+    }
 
-    string input;
+    // The reader is never joined, since it may be blocked on stdin when the
+    // engine quits
+    thread reader(readCommands);
+    reader.detach();
 
     while (true) {
-        getline(cin, input);
+        string input = nextCommand();
         // TODO tab can also be a delimiter
         vector<string> inputVector = split(input, ' ');
-        cin.clear();
 
         // The command is the first word in the string
         string command = inputVector.at(0);
@@ -207,6 +301,7 @@ int main(int argc, char **argv) {
                 boardSize = inputSize;
                 arraySize = inputSize + 2;
                 game.reset();
+                keyStackSize = 0;
                 resetSearchState();
                 cout << "= " << endl << endl;
             }
@@ -215,6 +310,7 @@ int main(int argc, char **argv) {
         else if (command == "clear_board") {
             lastMove = MOVE_PASS;
             game.reset();
+            keyStackSize = 0;
             resetSearchState();
             cout << "= " << endl << endl;
         }
@@ -225,6 +321,46 @@ int main(int argc, char **argv) {
             cout << "= " << endl << endl;
         }
 
+        // Sets up the position before the given move of a record, or after
+        // its last move, in one step
+        else if (command == "loadsgf") {
+            SgfGame record;
+            if (inputVector.size() < 2 || !loadSgf(inputVector.at(1), record))
+                cout << "? cannot load file" << endl << endl;
+            else if (record.boardSize < 3 || record.boardSize > 21)
+                cout << "? unacceptable size" << endl << endl;
+            else {
+                int moveCount = -1;
+                if (inputVector.size() > 2)
+                    moveCount = stoi(inputVector.at(2)) - 1;
+
+                boardSize = record.boardSize;
+                arraySize = boardSize + 2;
+                komi = record.komi;
+                game.reset();
+                keyStackSize = 0;
+                resetSearchState();
+                int played = replaySgf(record, moveCount, game, keyStack,
+                    keyStackSize, 4096);
+                lastMove = (played > 0) ? record.moves[played-1] : MOVE_PASS;
+
+                if (debugOutput) {
+                    cerr << "loaded " << played << " moves" << endl << "   ";
+                    for (int i = 1; i <= boardSize; i++)
+                        cerr << COLUMNS[i] << " ";
+                    cerr << endl;
+
+                    game.errorPrint();
+
+                    cerr << "   ";
+                    for (int i = 1; i <= boardSize; i++)
+                        cerr << COLUMNS[i] << " ";
+                    cerr << endl;
+                }
+                cout << "= " << endl << endl;
+            }
+        }
+
 
         // Protocol / information commands
         else if (command == "protocol_version")
@@ -256,7 +392,121 @@ int main(int argc, char **argv) {
         }
 
 
+        // Evaluation commands
+        else if (command == "load_weights") {
+            if (loadNetWeights(inputVector.at(1)))
+                cout << "= " << endl << endl;
+            else
+                cout << "? cannot load weights" << endl << endl;
+        }
+
+        else if (command == "load_book") {
+            if (loadBook(inputVector.at(1)))
+                cout << "= " << endl << endl;
+            else
+                cout << "? cannot load book" << endl << endl;
+        }
+
+        else if (command == "save_cache") {
+            if (saveSearchCache(inputVector.at(1)))
+                cout << "= " << endl << endl;
+            else
+                cout << "? cannot save cache" << endl << endl;
+        }
+
+        else if (command == "load_cache") {
+            if (loadSearchCache(inputVector.at(1)))
+                cout << "= " << endl << endl;
+            else
+                cout << "? cannot load cache" << endl << endl;
+        }
+
+        else if (command == "mercy") {
+            int threshold = stoi(inputVector.at(1));
+            if (threshold < 0)
+                cout << "? threshold must not be negative" << endl << endl;
+            else {
+                setMercyThreshold(threshold);
+                cout << "= " << endl << endl;
+            }
+        }
+
+        else if (command == "playout_policy") {
+            string policy = inputVector.at(1);
+            if (policy == "random" || policy == "pattern"
+             || policy == "lockstep") {
+                setPatternPlayouts(policy == "pattern");
+                setLockstepPlayouts(policy == "lockstep");
+                cout << "= " << endl << endl;
+            }
+            else
+                cout << "? unknown policy" << endl << endl;
+        }
+
+        else if (command == "playout_ladders") {
+            string setting = inputVector.at(1);
+            if (setting == "on" || setting == "off") {
+                setPlayoutLadders(setting == "on");
+                cout << "= " << endl << endl;
+            }
+            else
+                cout << "? expected on or off" << endl << endl;
+        }
+
+        else if (command == "playout_replies") {
+            string setting = inputVector.at(1);
+            if (setting == "on" || setting == "off") {
+                setLastGoodReply(setting == "on");
+                cout << "= " << endl << endl;
+            }
+            else
+                cout << "? expected on or off" << endl << endl;
+        }
+
+        else if (command == "load_patterns") {
+            if (loadPatterns(inputVector.at(1))) {
+                setPatternPlayouts(true);
+                cout << "= " << endl << endl;
+            }
+            else
+                cout << "? cannot load patterns" << endl << endl;
+        }
+
+        else if (command == "net_weight") {
+            float weight = stof(inputVector.at(1));
+            if (weight < 0.0 || weight > 1.0)
+                cout << "? weight must be between 0 and 1" << endl << endl;
+            else {
+                setNetWeight(weight);
+                cout << "= " << endl << endl;
+            }
+        }
+
+
         // Debugging commands
+        // Reports the counters of the last search, or turns them on or off
+        else if (command == "stats") {
+            string setting = (inputVector.size() > 1) ? inputVector.at(1) : "";
+            if (setting == "on" || setting == "off") {
+                setStatsEnabled(setting == "on");
+                cout << "= " << endl << endl;
+            }
+            else if (!setting.empty())
+                cout << "? expected on or off" << endl << endl;
+            else {
+                cout << "= " << endl;
+                printStats(cout);
+                cout << endl;
+            }
+        }
+
+        // The table is part of the response. The game in progress is kept.
+        else if (command == "benchmark") {
+            cout << "= " << endl;
+            runBenchmark(cout);
+            cout << endl;
+        }
+
         else if (command == "showboard") {
             cout << "= " << endl;
             cout << "   ";
@@ -302,7 +552,74 @@ int main(int argc, char **argv) {
         }
 
 
+        else if (command == "analyze") {
+            // analyze <color> [interval_centiseconds [max_moves]]
+            Player p = stringToColor(inputVector.at(1));
+            AnalysisOptions options;
+            options.intervalMs = (inputVector.size() > 2)
+                ? 10 * stoi(inputVector.at(2)) : 1000;
+            options.maxMoves = (inputVector.size() > 3)
+                ? stoi(inputVector.at(3)) : 10;
+            options.callback = printAnalysis;
+
+            if (p == EMPTY)
+                cout << "? invalid color" << endl << endl;
+            else {
+                // The response stays open, with a line of statistics per
+                // interval, until the next command arrives
+                cout << "= " << endl;
+                beginInterruptible();
+                analyzePosition(p, lastMove, MAX_ANALYSIS_PLAYOUTS, options);
+                endInterruptible();
+                cout << endl;
+            }
+        }
+
+        else if (command == "solve") {
+            // solve <color> [max_nodes [max_seconds [threads]]]
+            Player p = stringToColor(inputVector.at(1));
+            uint64_t maxNodes = (inputVector.size() > 2)
+                ? stoull(inputVector.at(2)) : 10000000;
+            double maxSeconds = (inputVector.size() > 3)
+                ? stod(inputVector.at(3)) : 60.0;
+            int threads = (inputVector.size() > 4)
+                ? stoi(inputVector.at(4)) : 1;
+
+            if (p == EMPTY)
+                cout << "? invalid color" << endl << endl;
+            else if (boardSize > SOLVER_MAX_SIZE)
+                cout << "? board too large to solve" << endl << endl;
+            else {
+                SolveResult r = solveGame(game, p, maxNodes, maxSeconds,
+                    threads);
+                if (debugOutput) {
+                    cerr << "solver: " << r.nodes << " nodes in "
+                         << r.seconds << " sec" << endl;
+                }
+
+                string result = (r.result == SOLVE_WIN) ? "win"
+                              : (r.result == SOLVE_LOSS) ? "loss" : "unknown";
+                cout << "= " << result << " " << moveToString(r.bestMove)
+                     << endl << endl;
+            }
+        }
+
+
+        else if (command == "seed") {
+            setSearchSeed(stoull(inputVector.at(1)));
+            cout << "= " << endl << endl;
+        }
+
+        // The reader already stopped the searches queued before this command
+        else if (command == "stop") {
+            resumeSearch();
+            cout << "= " << endl << endl;
+        }
+
+
         else if (command == "quit") {
+            if (!cacheFile.empty() && !saveSearchCache(cacheFile))
+                cerr << "Could not save cache to " << cacheFile << endl;
             cout << "= " << endl << endl;
             break;
         }
@@ -318,6 +635,61 @@ int main(int argc, char **argv) {
 }
 
 
+//------------------------------------------------------------------------------
+//-----------------------------Command Reader-----------------------------------
+//------------------------------------------------------------------------------
+
+// Reads commands from stdin onto the command queue. A stop ends the search in
+// progress right away, rather than when its turn comes. End of input is
+// treated as quit.
+void readCommands() {
+    string input;
+    while (getline(cin, input)) {
+        if (input.empty())
+            continue;
+        string command = input.substr(0, input.find(' '));
+        lock_guard<mutex> lock(commandMutex);
+        if (command == "stop" || searchInterruptible.exchange(false))
+            stopSearch();
+        commandQueue.push_back(input);
+        commandReady.notify_one();
+    }
+
+    lock_guard<mutex> lock(commandMutex);
+    if (searchInterruptible.exchange(false))
+        stopSearch();
+    commandQueue.push_back("quit");
+    commandReady.notify_one();
+}
+
+// Makes the next command read interrupt the search. A command that was read
+// already interrupts it right away.
+void beginInterruptible() {
+    lock_guard<mutex> lock(commandMutex);
+    searchInterruptible = true;
+    if (!commandQueue.empty() && searchInterruptible.exchange(false))
+        stopSearch();
+}
+
+// Waits until the search has been interrupted, and clears the interruption.
+// A stop command is left for the command loop to clear.
+void endInterruptible() {
+    while (!isSearchStopped())
+        this_thread::sleep_for(chrono::milliseconds(5));
+    if (!searchInterruptible.exchange(false))
+        resumeSearch();
+}
+
+// Waits for the next command
+string nextCommand() {
+    unique_lock<mutex> lock(commandMutex);
+    commandReady.wait(lock, [] { return !commandQueue.empty(); });
+    string input = commandQueue.front();
+    commandQueue.pop_front();
+    return input;
+}
+
+
 //------------------------------------------------------------------------------
 //-----------------------------Parser Helpers-----------------------------------
 //------------------------------------------------------------------------------
@@ -333,6 +705,30 @@ Player stringToColor(string colorString) {
 }
 
 
+string moveToString(Move m) {
+    if (m == MOVE_PASS)
+        return "pass";
+    return COLUMNS[getX(m)] + to_string(getY(m));
+}
+
+// Prints one line of analysis in the format used by lz-analyze
+void printAnalysis(const vector<AnalysisMove> &moves) {
+    for (unsigned int i = 0; i < moves.size(); i++) {
+        const AnalysisMove &a = moves[i];
+        cout << "info move " << moveToString(a.m)
+             << " visits " << a.visits
+             << " winrate " << (int) (a.winrate * 10000)
+             << " scoreLead " << a.scoreLead
+             << " order " << i
+             << " pv";
+        for (unsigned int j = 0; j < a.pv.size(); j++)
+            cout << " " << moveToString(a.pv[j]);
+        cout << " ";
+    }
+    cout << endl;
+}
+
+
 // Split string s based on delimiter d
 vector<string> split(const string &s, char d) {
     vector<string> v;
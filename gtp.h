@@ -20,12 +20,16 @@ extern int keyStackSize;
 const string ENGINE_NAME = "Go Engine";
 const string VERSION = "0.0";
 
-const int NUM_KNOWN_COMMANDS = 14;
+const int NUM_KNOWN_COMMANDS = 31;
 const string KNOWN_COMMANDS[NUM_KNOWN_COMMANDS] = {
     "play", "genmove",
-    "boardsize", "clear_board", "komi", "fixed_handicap",
+    "boardsize", "clear_board", "komi", "fixed_handicap", "loadsgf",
     "protocol_version", "name", "version", "known_command", "list_commands",
-    "showboard", "selfplay",
+    "load_weights", "net_weight", "load_book", "save_cache", "load_cache",
+    "mercy", "playout_policy", "load_patterns",
+    "playout_ladders", "playout_replies", "showboard", "selfplay", "analyze",
+    "benchmark", "stats",
+    "solve", "seed", "stop",
     "quit"
 };
 
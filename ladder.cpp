@@ -0,0 +1,404 @@
+#include <atomic>
+#include <cstddef>
+#include "ladder.h"
+
+
+/*
+ * Ladder reading is done on a scratch overlay on top of a Board. Moves are
+ * made by writing into the overlay and recording the old values on an undo
+ * stack, so reading never copies or modifies the Board and never allocates.
+ * All scratch state is per thread.
+ */
+const int MAX_POINTS = 27 * 27;
+// Overlay value for a point that is the same as on the board
+const Stone UNSET = 3;
+const int MAX_UNDO = 4096;
+// Readings that take more nodes than this are assumed to escape: the prey is
+// not reported as captured, and the escape is extending at its last liberty
+const int MAX_LADDER_NODES = 400;
+
+const int DX[4] = {1, -1, 0, 0};
+const int DY[4] = {0, 0, 1, -1};
+
+struct LadderReader {
+    Board *board;
+    bool initialized;
+    Stone overlay[MAX_POINTS];
+    int undoIndex[MAX_UNDO];
+    Stone undoValue[MAX_UNDO];
+    int undoSize;
+    // Flood fill marks, valid when equal to the current generation
+    int mark[MAX_POINTS];
+    int generation;
+    Move stack[MAX_POINTS];
+    int nodes;
+
+    void begin(Board &b);
+    Stone get(int x, int y);
+    void set(int x, int y, Stone s);
+    void undo(int size);
+    int countLiberties(int x, int y, int max, Move *libs);
+    void removeChain(int x, int y);
+    void play(Player p, int x, int y);
+    int atariLiberties(int x, int y, Move *moves);
+    bool preyMove(int x, int y, Move *escape);
+    bool hunterMove(int x, int y);
+};
+
+static thread_local LadderReader reader;
+
+
+void LadderReader::begin(Board &b) {
+    if (!initialized) {
+        for (int i = 0; i < MAX_POINTS; i++) {
+            overlay[i] = UNSET;
+            mark[i] = 0;
+        }
+        generation = 0;
+        initialized = true;
+    }
+    board = &b;
+    undoSize = 0;
+    nodes = 0;
+}
+
+inline Stone LadderReader::get(int x, int y) {
+    Stone s = overlay[x + y * arraySize];
+    return (s != UNSET) ? s : board->getStone(x, y);
+}
+
+inline void LadderReader::set(int x, int y, Stone s) {
+    int i = x + y * arraySize;
+    undoIndex[undoSize] = i;
+    undoValue[undoSize] = overlay[i];
+    undoSize++;
+    overlay[i] = s;
+}
+
+// Takes back every change made since the undo stack had the given size
+void LadderReader::undo(int size) {
+    while (undoSize > size) {
+        undoSize--;
+        overlay[undoIndex[undoSize]] = undoValue[undoSize];
+    }
+}
+
+// Counts the liberties of the chain at (x, y), stopping once max liberties
+// have been found. The liberties found are stored in libs if it is not NULL.
+int LadderReader::countLiberties(int x, int y, int max, Move *libs) {
+    Player color = get(x, y);
+    generation++;
+    int count = 0;
+    int top = 0;
+    stack[top++] = coordToMove(x, y);
+    mark[x + y * arraySize] = generation;
+
+    while (top > 0) {
+        Move m = stack[--top];
+        int cx = getX(m);
+        int cy = getY(m);
+        for (int d = 0; d < 4; d++) {
+            int nx = cx + DX[d];
+            int ny = cy + DY[d];
+            int ni = nx + ny * arraySize;
+            if (mark[ni] == generation)
+                continue;
+            Stone s = get(nx, ny);
+            if (s == EMPTY) {
+                mark[ni] = generation;
+                if (libs != NULL)
+                    libs[count] = coordToMove(nx, ny);
+                count++;
+                if (count >= max)
+                    return count;
+            }
+            else if (s == color) {
+                mark[ni] = generation;
+                stack[top++] = coordToMove(nx, ny);
+            }
+        }
+    }
+
+    return count;
+}
+
+void LadderReader::removeChain(int x, int y) {
+    Player color = get(x, y);
+    int top = 0;
+    stack[top++] = coordToMove(x, y);
+    set(x, y, EMPTY);
+
+    while (top > 0) {
+        Move m = stack[--top];
+        for (int d = 0; d < 4; d++) {
+            int nx = getX(m) + DX[d];
+            int ny = getY(m) + DY[d];
+            if (get(nx, ny) == color) {
+                set(nx, ny, EMPTY);
+                stack[top++] = coordToMove(nx, ny);
+            }
+        }
+    }
+}
+
+// Places a stone and removes any opponent chains left without liberties
+void LadderReader::play(Player p, int x, int y) {
+    set(x, y, p);
+    Player victim = otherPlayer(p);
+    for (int d = 0; d < 4; d++) {
+        int nx = x + DX[d];
+        int ny = y + DY[d];
+        if (get(nx, ny) == victim && countLiberties(nx, ny, 1, NULL) == 0)
+            removeChain(nx, ny);
+    }
+}
+
+// Finds the moves that capture an opponent chain in atari next to the chain
+// at (x, y). Returns the number of moves found.
+int LadderReader::atariLiberties(int x, int y, Move *moves) {
+    Player color = get(x, y);
+    Player hunter = otherPlayer(color);
+    int count = 0;
+
+    // Collect the chain's stones first, since countLiberties() reuses the
+    // flood fill marks
+    Move stones[MAX_POINTS];
+    int numStones = 0;
+    generation++;
+    int top = 0;
+    stack[top++] = coordToMove(x, y);
+    mark[x + y * arraySize] = generation;
+    while (top > 0) {
+        Move m = stack[--top];
+        stones[numStones++] = m;
+        for (int d = 0; d < 4; d++) {
+            int nx = getX(m) + DX[d];
+            int ny = getY(m) + DY[d];
+            int ni = nx + ny * arraySize;
+            if (mark[ni] != generation && get(nx, ny) == color) {
+                mark[ni] = generation;
+                stack[top++] = coordToMove(nx, ny);
+            }
+        }
+    }
+
+    for (int i = 0; i < numStones; i++) {
+        for (int d = 0; d < 4; d++) {
+            int nx = getX(stones[i]) + DX[d];
+            int ny = getY(stones[i]) + DY[d];
+            if (get(nx, ny) != hunter)
+                continue;
+            Move lib;
+            if (countLiberties(nx, ny, 2, &lib) != 1)
+                continue;
+            bool repeat = false;
+            for (int j = 0; j < count; j++)
+                if (moves[j] == lib)
+                    repeat = true;
+            if (!repeat && count < 8)
+                moves[count++] = lib;
+        }
+    }
+
+    return count;
+}
+
+// The prey, whose chain at (x, y) is in atari, is to move. Returns true if
+// the chain is captured however it tries to escape. Otherwise, the escaping
+// move is stored in escape if it is not NULL. Once the reading runs out of
+// nodes, the prey is taken to escape.
+bool LadderReader::preyMove(int x, int y, Move *escape) {
+    Player prey = get(x, y);
+    // Extending at the last liberty, or capturing a chain next to the prey
+    Move candidates[9];
+    int numCandidates = 0;
+    if (countLiberties(x, y, 2, candidates) != 1)
+        return false;
+
+    if (++nodes > MAX_LADDER_NODES) {
+        if (escape != NULL)
+            *escape = candidates[0];
+        return false;
+    }
+    numCandidates = 1 + atariLiberties(x, y, candidates + 1);
+
+    for (int i = 0; i < numCandidates; i++) {
+        int saved = undoSize;
+        play(prey, getX(candidates[i]), getY(candidates[i]));
+        int libs = countLiberties(x, y, 3, NULL);
+
+        bool captured;
+        if (libs >= 3)
+            captured = false;
+        else if (libs <= 1)
+            captured = true;
+        else
+            captured = hunterMove(x, y);
+        undo(saved);
+
+        if (!captured) {
+            if (escape != NULL)
+                *escape = candidates[i];
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The hunter is to move against the prey chain at (x, y), which has two
+// liberties. Returns true if an atari on either liberty captures the chain.
+bool LadderReader::hunterMove(int x, int y) {
+    Player hunter = otherPlayer(get(x, y));
+    Move libs[2];
+    if (countLiberties(x, y, 3, libs) != 2)
+        return false;
+
+    for (int i = 0; i < 2; i++) {
+        int ax = getX(libs[i]);
+        int ay = getY(libs[i]);
+        int saved = undoSize;
+        play(hunter, ax, ay);
+        bool captured = countLiberties(ax, ay, 1, NULL) > 0
+                     && countLiberties(x, y, 2, NULL) == 1
+                     && preyMove(x, y, NULL);
+        undo(saved);
+        if (captured)
+            return true;
+    }
+
+    return false;
+}
+
+
+//------------------------------------------------------------------------------
+//---------------------------------Ladder Cache---------------------------------
+//------------------------------------------------------------------------------
+/*
+ * Results are cached by the Zobrist key of the position mixed with the
+ * question being asked. Each entry stores the upper bits of the key with a
+ * 16 bit result in the low bits, and is read and written atomically, so the
+ * cache is shared between threads without locks. A mismatched key is simply a
+ * miss.
+ */
+const int LADDER_CACHE_SIZE = 1 << 16;
+const uint64_t RESULT_MASK = 0xFFFF;
+static std::atomic<uint64_t> ladderCache[LADDER_CACHE_SIZE];
+
+// Tags that keep the different queries about the same chain apart
+const uint64_t CAPTURED_TAG = 0x1;
+const uint64_t ESCAPE_TAG = 0x2;
+
+inline uint64_t ladderKey(Board &b, Move m, uint64_t tag) {
+    uint64_t k = b.getZobristKey();
+    k ^= (uint64_t) m * 0x9E3779B97F4A7C15ULL;
+    k ^= (tag << 20) * 0xC2B2AE3D27D4EB4FULL;
+    return k;
+}
+
+static bool probe(uint64_t key, uint16_t &result) {
+    uint64_t entry = ladderCache[(key >> 16) & (LADDER_CACHE_SIZE-1)]
+                         .load(std::memory_order_relaxed);
+    if (((entry ^ key) & ~RESULT_MASK) != 0)
+        return false;
+    result = (uint16_t) (entry & RESULT_MASK);
+    return true;
+}
+
+static void store(uint64_t key, uint16_t result) {
+    ladderCache[(key >> 16) & (LADDER_CACHE_SIZE-1)].store(
+        (key & ~RESULT_MASK) | result, std::memory_order_relaxed);
+}
+
+
+//------------------------------------------------------------------------------
+//--------------------------------Ladder Queries--------------------------------
+//------------------------------------------------------------------------------
+
+// Returns true if the chain at m, which must be in atari, is captured with
+// its owner to move.
+bool isLadderCaptured(Board &b, Move m) {
+    uint64_t key = ladderKey(b, m, CAPTURED_TAG);
+    uint16_t result;
+    if (probe(key, result))
+        return result;
+
+    reader.begin(b);
+    result = reader.preyMove(getX(m), getY(m), NULL);
+    store(key, result);
+    return result;
+}
+
+// Returns true if player p playing atari on the chain at m, which must have
+// two liberties, captures the chain in a ladder.
+bool isLadderAtari(Board &b, Player p, Move atari, Move m) {
+    uint64_t key = ladderKey(b, m, (uint64_t) atari << 2);
+    uint16_t result;
+    if (probe(key, result))
+        return result;
+
+    reader.begin(b);
+    int x = getX(m);
+    int y = getY(m);
+    reader.play(p, getX(atari), getY(atari));
+    result = reader.countLiberties(getX(atari), getY(atari), 1, NULL) > 0
+          && reader.countLiberties(x, y, 2, NULL) == 1
+          && reader.preyMove(x, y, NULL);
+    reader.undo(0);
+    store(key, result);
+    return result;
+}
+
+// Given the opponent's last move, returns a move that saves one of p's chains
+// put into atari by it, if one of them can escape. Unlike
+// Board::getPotentialEscape(), ladders are read out. Returns MOVE_PASS if there
+// is no working escape. A ladder too long to read counts as escaping.
+Move getLadderEscape(Board &b, Player p, Move last) {
+    if (last == MOVE_PASS)
+        return MOVE_PASS;
+
+    for (int d = 0; d < 4; d++) {
+        int x = getX(last) + DX[d];
+        int y = getY(last) + DY[d];
+        if (b.getStone(x, y) != p)
+            continue;
+
+        Move chain = coordToMove(x, y);
+        uint64_t key = ladderKey(b, chain, ESCAPE_TAG);
+        uint16_t escape;
+        if (!probe(key, escape)) {
+            escape = MOVE_PASS;
+            reader.begin(b);
+            if (reader.countLiberties(x, y, 2, NULL) == 1)
+                reader.preyMove(x, y, &escape);
+            store(key, escape);
+        }
+        if (escape != MOVE_PASS)
+            return escape;
+    }
+
+    return MOVE_PASS;
+}
+
+// Returns a move for p that puts the chain of the opponent's last move into a
+// working ladder, or MOVE_PASS if there is none.
+Move getLadderCapture(Board &b, Player p, Move last) {
+    if (last == MOVE_PASS)
+        return MOVE_PASS;
+    int x = getX(last);
+    int y = getY(last);
+    if (b.getStone(x, y) != otherPlayer(p))
+        return MOVE_PASS;
+
+    Move libs[2];
+    reader.begin(b);
+    if (reader.countLiberties(x, y, 3, libs) != 2)
+        return MOVE_PASS;
+
+    for (int i = 0; i < 2; i++) {
+        if (isLadderAtari(b, p, libs[i], last))
+            return libs[i];
+    }
+
+    return MOVE_PASS;
+}
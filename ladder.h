@@ -0,0 +1,12 @@
+#ifndef __LADDER_H__
+#define __LADDER_H__
+
+#include "board.h"
+#include "types.h"
+
+bool isLadderCaptured(Board &b, Move m);
+bool isLadderAtari(Board &b, Player p, Move atari, Move m);
+Move getLadderEscape(Board &b, Player p, Move last);
+Move getLadderCapture(Board &b, Player p, Move last);
+
+#endif
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include "lockstep.h"
+
+
+extern int boardSize;
+
+
+const int LANES = LOCKSTEP_LANES;
+const int MAX_POINTS = 27 * 27;
+const uint16_t NO_POINT = 0xFFFF;
+// Off-board points. EDGE & BLACK and EDGE & WHITE are both nonzero, which
+// lets the eye test below be done with bitwise ands.
+const uint8_t EDGE = 3;
+
+/*
+ * Chains are kept as circular linked lists of stones, with every stone
+ * pointing at the chain's head. The head holds the chain's size and its
+ * pseudo-liberties: the number of (stone, empty neighbor) pairs, and the sum
+ * and sum of squares of those empty points. A chain is in atari exactly when
+ * all its pseudo-liberties are the same point, which is when
+ * libs * libSumSq == libSum * libSum, and that point is libSum / libs.
+ */
+struct LockstepState {
+    uint8_t color[MAX_POINTS][LANES];
+    uint16_t head[MAX_POINTS][LANES];
+    uint16_t next[MAX_POINTS][LANES];
+    uint16_t size[MAX_POINTS][LANES];
+    uint16_t libs[MAX_POINTS][LANES];
+    uint32_t libSum[MAX_POINTS][LANES];
+    uint32_t libSumSq[MAX_POINTS][LANES];
+    // Position of each empty point in its lane's empty list
+    uint16_t emptyIndex[MAX_POINTS][LANES];
+
+    uint16_t empties[LANES][MAX_POINTS];
+    int numEmpty[LANES];
+    int captures[LANES][3];
+    Player toMove[LANES];
+    uint16_t ko[LANES];
+    int koCaptures[LANES];
+    uint16_t last[LANES];
+    int passes[LANES];
+    bool active[LANES];
+    // The capture difference when the lane was loaded, and the side that won
+    // by the mercy rule, if any
+    int startLead[LANES];
+    Player mercyWinner[LANES];
+};
+
+// Large enough that it should not live on the stack
+static thread_local LockstepState st;
+// Neighbor offsets for the current board size, set by each call to
+// playLockstepGames() on its own thread
+static thread_local int offsets[4];
+
+
+inline bool inAtari(int l, int h) {
+    uint64_t libs = st.libs[h][l];
+    uint64_t sum = st.libSum[h][l];
+    return libs > 0 && libs * st.libSumSq[h][l] == sum * sum;
+}
+
+inline void addLib(int l, int h, int pt) {
+    st.libs[h][l]++;
+    st.libSum[h][l] += pt;
+    st.libSumSq[h][l] += pt * pt;
+}
+
+inline void removeLib(int l, int h, int pt) {
+    st.libs[h][l]--;
+    st.libSum[h][l] -= pt;
+    st.libSumSq[h][l] -= pt * pt;
+}
+
+inline void addEmpty(int l, int pt) {
+    st.emptyIndex[pt][l] = st.numEmpty[l];
+    st.empties[l][st.numEmpty[l]++] = pt;
+}
+
+inline void removeEmpty(int l, int pt) {
+    int i = st.emptyIndex[pt][l];
+    int moved = st.empties[l][--st.numEmpty[l]];
+    st.empties[l][i] = moved;
+    st.emptyIndex[moved][l] = i;
+}
+
+// Merges chain b into chain a
+static void merge(int l, int a, int b) {
+    int s = b;
+    do {
+        st.head[s][l] = a;
+        s = st.next[s][l];
+    } while (s != b);
+
+    uint16_t t = st.next[a][l];
+    st.next[a][l] = st.next[b][l];
+    st.next[b][l] = t;
+
+    st.size[a][l] += st.size[b][l];
+    st.libs[a][l] += st.libs[b][l];
+    st.libSum[a][l] += st.libSum[b][l];
+    st.libSumSq[a][l] += st.libSumSq[b][l];
+}
+
+// Removes a captured chain and returns the number of stones removed
+static int removeChain(int l, int h) {
+    int s = h;
+    do {
+        st.color[s][l] = EMPTY;
+        addEmpty(l, s);
+        s = st.next[s][l];
+    } while (s != h);
+
+    // Give the freed points back to the surrounding chains as liberties
+    do {
+        for (int d = 0; d < 4; d++) {
+            int nb = s + offsets[d];
+            uint8_t c = st.color[nb][l];
+            if (c == BLACK || c == WHITE)
+                addLib(l, st.head[nb][l], s);
+        }
+        s = st.next[s][l];
+    } while (s != h);
+
+    return st.size[h][l];
+}
+
+inline bool isEye(int l, int pt, Player c) {
+    for (int d = 0; d < 4; d++) {
+        uint8_t nc = st.color[pt + offsets[d]][l];
+        if (nc != c && nc != EDGE)
+            return false;
+    }
+    return true;
+}
+
+// Returns true if c may play on the empty point pt: it is not the ko point,
+// and the move is not suicide
+static bool isLegal(int l, int pt, Player c) {
+    if (pt == st.ko[l])
+        return false;
+    for (int d = 0; d < 4; d++) {
+        int nb = pt + offsets[d];
+        uint8_t nc = st.color[nb][l];
+        if (nc == EMPTY)
+            return true;
+        if (nc == EDGE)
+            continue;
+        // Connecting to an own chain with another liberty, or capturing
+        if ((nc == c) != inAtari(l, st.head[nb][l]))
+            return true;
+    }
+    return false;
+}
+
+static void play(int l, int pt, Player c) {
+    st.color[pt][l] = c;
+    removeEmpty(l, pt);
+    st.head[pt][l] = pt;
+    st.next[pt][l] = pt;
+    st.size[pt][l] = 1;
+    st.libs[pt][l] = 0;
+    st.libSum[pt][l] = 0;
+    st.libSumSq[pt][l] = 0;
+
+    for (int d = 0; d < 4; d++) {
+        int nb = pt + offsets[d];
+        uint8_t nc = st.color[nb][l];
+        if (nc == EMPTY)
+            addLib(l, pt, nb);
+        else if (nc != EDGE)
+            removeLib(l, st.head[nb][l], pt);
+    }
+
+    for (int d = 0; d < 4; d++) {
+        int nb = pt + offsets[d];
+        if (st.color[nb][l] != c)
+            continue;
+        int a = st.head[pt][l];
+        int b = st.head[nb][l];
+        if (a == b)
+            continue;
+        // Relabel the smaller chain
+        if (st.size[a][l] < st.size[b][l])
+            merge(l, b, a);
+        else
+            merge(l, a, b);
+    }
+
+    Player victim = otherPlayer(c);
+    int captured = 0;
+    int capturePoint = NO_POINT;
+    for (int d = 0; d < 4; d++) {
+        int nb = pt + offsets[d];
+        if (st.color[nb][l] == victim && st.libs[st.head[nb][l]][l] == 0) {
+            captured += removeChain(l, st.head[nb][l]);
+            capturePoint = nb;
+        }
+    }
+    st.captures[l][c] += captured;
+
+    // A single stone that captured a single stone and is now in atari can be
+    // recaptured only after a move elsewhere
+    int h = st.head[pt][l];
+    if (captured == 1 && st.size[h][l] == 1 && inAtari(l, h)) {
+        st.ko[l] = capturePoint;
+        st.koCaptures[l]++;
+    }
+    else
+        st.ko[l] = NO_POINT;
+}
+
+// Copies a board into a lane
+static void load(int l, Board &b, Player p) {
+    int points = arraySize * arraySize;
+    st.numEmpty[l] = 0;
+    for (int pt = 0; pt < points; pt++) {
+        Stone s = b.getStone(pt % arraySize, pt / arraySize);
+        st.color[pt][l] = (s == -1) ? EDGE : s;
+        st.head[pt][l] = pt;
+        st.next[pt][l] = pt;
+        st.size[pt][l] = 1;
+        st.libs[pt][l] = 0;
+        st.libSum[pt][l] = 0;
+        st.libSumSq[pt][l] = 0;
+        if (s == EMPTY)
+            addEmpty(l, pt);
+    }
+
+    // Give every stone its liberties as a single stone chain, then join
+    // neighboring stones
+    for (int pt = 0; pt < points; pt++) {
+        if (st.color[pt][l] != BLACK && st.color[pt][l] != WHITE)
+            continue;
+        for (int d = 0; d < 4; d++) {
+            int nb = pt + offsets[d];
+            if (nb >= 0 && nb < points && st.color[nb][l] == EMPTY)
+                addLib(l, pt, nb);
+        }
+    }
+    for (int pt = 0; pt < points; pt++) {
+        uint8_t c = st.color[pt][l];
+        if (c != BLACK && c != WHITE)
+            continue;
+        for (int d = 0; d < 4; d++) {
+            int nb = pt + offsets[d];
+            if (nb < 0 || nb >= points || st.color[nb][l] != c)
+                continue;
+            int a = st.head[pt][l];
+            int h = st.head[nb][l];
+            if (a == h)
+                continue;
+            if (st.size[a][l] < st.size[h][l])
+                merge(l, h, a);
+            else
+                merge(l, a, h);
+        }
+    }
+
+    st.captures[l][EMPTY] = 0;
+    st.captures[l][BLACK] = b.getCapturedStones(BLACK);
+    st.captures[l][WHITE] = b.getCapturedStones(WHITE);
+    st.toMove[l] = p;
+    // A ko left on the board binds the first move
+    Move ko = b.getKoPoint(p);
+    st.ko[l] = (ko == MOVE_NULL) ? NO_POINT : getX(ko) + getY(ko) * arraySize;
+    st.koCaptures[l] = 0;
+    st.last[l] = NO_POINT;
+    st.passes[l] = 0;
+    st.active[l] = true;
+    st.startLead[l] = b.getCaptureDifference(BLACK);
+    st.mercyWinner[l] = EMPTY;
+}
+
+// Plays one move in a lane
+static void step(int l, Rng &rng, int mercyThreshold) {
+    Player c = st.toMove[l];
+    int m = NO_POINT;
+
+    // Capture the last move's chain if it is in atari
+    int last = st.last[l];
+    if (last != NO_POINT && st.color[last][l] != EMPTY) {
+        int h = st.head[last][l];
+        if (inAtari(l, h)) {
+            int lib = st.libSum[h][l] / st.libs[h][l];
+            if (isLegal(l, lib, c))
+                m = lib;
+        }
+    }
+
+    // Otherwise, try random moves without replacement. Rejected points are
+    // swapped to the end of the empty list.
+    int avail = st.numEmpty[l];
+    while (m == NO_POINT && avail > 0) {
+        int i = rng.bounded(avail);
+        int pt = st.empties[l][i];
+        if (!isEye(l, pt, c) && isLegal(l, pt, c)) {
+            m = pt;
+            break;
+        }
+        avail--;
+        int moved = st.empties[l][avail];
+        st.empties[l][i] = moved;
+        st.emptyIndex[moved][l] = i;
+        st.empties[l][avail] = pt;
+        st.emptyIndex[pt][l] = avail;
+    }
+
+    if (m == NO_POINT) {
+        st.passes[l]++;
+        st.ko[l] = NO_POINT;
+        if (st.passes[l] >= 2)
+            st.active[l] = false;
+    }
+    else {
+        play(l, m, c);
+        st.passes[l] = 0;
+        // Multiple kos can cycle forever, which simple ko does not prevent.
+        // Games that keep retaking kos are stopped and scored as they are.
+        if (st.koCaptures[l] > boardSize)
+            st.active[l] = false;
+
+        if (mercyThreshold) {
+            int lead = st.captures[l][BLACK] - st.captures[l][WHITE]
+                - st.startLead[l];
+            if (lead > mercyThreshold || -lead > mercyThreshold) {
+                st.mercyWinner[l] = (lead > 0) ? BLACK : WHITE;
+                st.active[l] = false;
+            }
+        }
+    }
+    st.last[l] = m;
+    st.toMove[l] = otherPlayer(c);
+}
+
+// Captures and single point territory, the only kind left at the end of a
+// random game. The inner loop runs over the lanes without branches.
+static void score(int *lead) {
+    for (int l = 0; l < LANES; l++)
+        lead[l] = st.captures[l][BLACK] - st.captures[l][WHITE];
+
+    for (int y = 1; y <= boardSize; y++) {
+        for (int x = 1; x <= boardSize; x++) {
+            int pt = x + y * arraySize;
+            const uint8_t *c = st.color[pt];
+            const uint8_t *e = st.color[pt+1];
+            const uint8_t *w = st.color[pt-1];
+            const uint8_t *n = st.color[pt+arraySize];
+            const uint8_t *s = st.color[pt-arraySize];
+            for (int l = 0; l < LANES; l++) {
+                int all = e[l] & w[l] & n[l] & s[l];
+                lead[l] += (c[l] == EMPTY) * ((all & BLACK) - ((all & WHITE) >> 1));
+            }
+        }
+    }
+}
+
+void playLockstepGames(Board **boards, const Player *toMove, int n, Rng &rng,
+    int mercyThreshold, int *blackLead, Player *mercyWinner) {
+    offsets[0] = 1;
+    offsets[1] = -1;
+    offsets[2] = arraySize;
+    offsets[3] = -arraySize;
+    int maxMoves = 3 * boardSize * boardSize;
+
+    for (int first = 0; first < n; first += LANES) {
+        int lanes = std::min(LANES, n - first);
+        for (int l = 0; l < lanes; l++)
+            load(l, *(boards[first + l]), toMove[first + l]);
+        // Unused lanes are scored but never played
+        for (int l = lanes; l < LANES; l++) {
+            st.active[l] = false;
+            for (int pt = 0; pt < arraySize * arraySize; pt++)
+                st.color[pt][l] = EDGE;
+            st.captures[l][BLACK] = st.captures[l][WHITE] = 0;
+        }
+
+        bool running = true;
+        for (int moves = 0; moves < maxMoves && running; moves++) {
+            running = false;
+            for (int l = 0; l < lanes; l++) {
+                if (!st.active[l])
+                    continue;
+                step(l, rng, mercyThreshold);
+                running = true;
+            }
+        }
+
+        int lead[LANES];
+        score(lead);
+        for (int l = 0; l < lanes; l++) {
+            mercyWinner[first + l] = st.mercyWinner[l];
+            if (st.mercyWinner[l] != EMPTY)
+                lead[l] = st.captures[l][BLACK] - st.captures[l][WHITE];
+            blackLead[first + l] = lead[l];
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+
+#include "board.h"
+#include "rng.h"
+#include "types.h"
+
+/*
+ * A playout engine that plays several independent random games in lockstep.
+ * Board state is stored structure-of-arrays across games, [point][lane], so
+ * that the state of one point for all games is contiguous and the per-point
+ * loops (setup, scoring) run over the lanes with SIMD. Each step advances
+ * every unfinished game by one move, which keeps the working sets of all
+ * lanes hot in cache and overlaps their memory latency.
+ *
+ * The playout policy is the same as playRandomGame(): capture the last move
+ * if it is in atari, otherwise a uniformly random move that does not fill
+ * an own eye. Simple ko is respected, and so is the mercy rule.
+ */
+const int LOCKSTEP_LANES = 8;
+
+// Plays out n games from the given boards, which are not modified, with
+// toMove[i] to play on boards[i]. blackLead[i] receives black's captures and
+// territory minus white's, without komi. n may be larger than the number of
+// lanes, in which case the games are played in groups.
+// If mercyThreshold is nonzero, a game in which one side captures more than
+// that many stones more than the other is stopped, and mercyWinner[i] is set
+// to that side, with blackLead[i] the capture difference only. Otherwise
+// mercyWinner[i] is EMPTY.
+void playLockstepGames(Board **boards, const Player *toMove, int n, Rng &rng,
+    int mercyThreshold, int *blackLead, Player *mercyWinner);
+
+#endif
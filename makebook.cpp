@@ -0,0 +1,101 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "board.h"
+#include "book.h"
+#include "patterns.h"
+#include "sgf.h"
+
+using namespace std;
+
+
+/*
+ * Builds an opening book from SGF game records, such as those written by
+ * go-selfplay or collected from online play. The first moves of each game are
+ * counted by position, and the moves played often enough are written out.
+ *
+ * Usage: go-book [options] files...
+ *   --output FILE     the book file (default: book.bin)
+ *   --moves N         count the first N moves of each game (default 12)
+ *   --min-count N     keep moves played at least N times (default 2)
+ *   --winners         only count the moves of the side that won
+ *
+ * Positions are keyed by the komi of their game, and the engine only uses
+ * moves recorded at its own komi, so the records should be played at the
+ * komi the engine will use.
+ */
+
+extern int boardSize;
+extern int arraySize;
+extern Board game;
+extern uint64_t keyStack[4096];
+extern int keyStackSize;
+
+bool debugOutput = false;
+
+int main(int argc, char **argv) {
+    initZobristTable();
+    initPatterns();
+
+    string output = "book.bin";
+    int maxMoves = 12;
+    int minCount = 2;
+    bool winnersOnly = false;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg == "--output" && i+1 < argc)
+            output = string(argv[++i]);
+        else if (arg == "--moves" && i+1 < argc)
+            maxMoves = stoi(string(argv[++i]));
+        else if (arg == "--min-count" && i+1 < argc)
+            minCount = stoi(string(argv[++i]));
+        else if (arg == "--winners")
+            winnersOnly = true;
+        else
+            files.push_back(arg);
+    }
+
+    BookBuilder builder;
+    SgfGame record;
+    int games = 0;
+    for (unsigned int f = 0; f < files.size(); f++) {
+        if (!loadSgf(files[f], record)) {
+            cerr << "Could not read " << files[f] << endl;
+            continue;
+        }
+        if (record.boardSize < 3 || record.boardSize > 21)
+            continue;
+        if (winnersOnly && record.winner == EMPTY)
+            continue;
+
+        boardSize = record.boardSize;
+        arraySize = boardSize + 2;
+        game.reset();
+        keyStackSize = 0;
+        replaySgf(record, 0, game, keyStack, keyStackSize, 4096);
+
+        int moves = min(maxMoves, (int) record.moves.size());
+        for (int i = 0; i < moves; i++) {
+            Player p = record.colors[i];
+            Move m = record.moves[i];
+            // Passes in the opening are left to the search
+            if (m == MOVE_PASS || game.getStone(getX(m), getY(m)) != EMPTY)
+                break;
+            if (!winnersOnly || p == record.winner)
+                builder.add(game, p, m, record.komi);
+            playSgfMove(game, p, m, keyStack, keyStackSize);
+        }
+        games++;
+    }
+
+    int entries = builder.write(output, minCount);
+    if (entries < 0) {
+        cerr << "Could not write " << output << endl;
+        return 1;
+    }
+    cerr << "Wrote " << entries << " moves from " << games << " games to "
+         << output << endl;
+    return 0;
+}
@@ -1,24 +1,22 @@
 #include <cmath>
-#include <ctime>
-#include <random>
 #include "board.h"
 #include "mctree.h"
 
 
-std::default_random_engine mc_rng(time(NULL));
-
-
 // Finds a node to attach a new branch to, and updates a board to the
 // corresponding position
-MCNode *MCTree::findLeaf(Player &p, Board &b, int &depth) {
+MCNode *MCTree::findLeaf(Player &p, Board &b, int &depth, Rng &rng) {
+    PhaseTimer timer(PHASE_SELECTION);
     MCNode *node = root;
 
     // Keep going until we either decide to split another child, or find a leaf
     while (node->size > 0) {
-        std::uniform_int_distribution<int> distribution(0, b.getLegalMoves(p).size() / 2);
         // Create a new child for this node with some probability
-        if (node != root && distribution(mc_rng) > node->size)
-            break;
+        if (node != root) {
+            int threshold = rng.bounded(b.getLegalMoves(p).size() / 2 + 1);
+            if (threshold > node->size)
+                break;
+        }
 
         // Otherwise, choose a child to follow
         double bestScore = 0.0;
@@ -42,22 +40,44 @@ MCNode *MCTree::findLeaf(Player &p, Board &b, int &depth) {
     return node;
 }
 
-void MCTree::backPropagate(MCNode *leaf) {
-    int n = leaf->numerator;
-    int d = leaf->denominator;
-    int diff = leaf->scoreDiff;
+// Adds the result of a single playout to all ancestors of the leaf. The leaf's
+// own statistics are set by the caller. n and diff are from the point of view
+// of the player who moved into the leaf.
+void MCTree::backPropagate(MCNode *leaf, float n, int diff) {
+    PhaseTimer timer(PHASE_BACKPROPAGATION);
+    leaf->visits++;
 
     MCNode *node = leaf->parent;
     // Flip whether the game was won or not since each level of the tree is
     // from the POV of the opposing player
-    n ^= 1;
+    n = 1 - n;
     diff = -diff;
     while (node != NULL) {
         node->numerator += n;
-        node->denominator += d;
+        node->denominator++;
         node->scoreDiff += diff;
-        n ^= 1;
+        node->visits++;
+        n = 1 - n;
         diff = -diff;
         node = node->parent;
     }
 }
+
+// While a leaf is waiting for evaluation, count it as a visit with no wins
+// for every node along its path. This steers other descents elsewhere. The
+// leaf's own placeholder denominator of 1 already acts as its virtual loss.
+void MCTree::addVirtualLoss(MCNode *leaf) {
+    leaf->visits++;
+    for (MCNode *node = leaf->parent; node != NULL; node = node->parent) {
+        node->denominator++;
+        node->visits++;
+    }
+}
+
+void MCTree::removeVirtualLoss(MCNode *leaf) {
+    leaf->visits--;
+    for (MCNode *node = leaf->parent; node != NULL; node = node->parent) {
+        node->denominator--;
+        node->visits--;
+    }
+}
@@ -1,23 +1,33 @@
 #ifndef __MCTREE_H__
 #define __MCTREE_H__
 
+#include "rng.h"
+#include "stats.h"
 #include "types.h"
 
 struct MCNode {
-    int numerator;
+    float numerator;
     int denominator;
     int64_t scoreDiff;
+    // Number of playouts through this node, not counting priors
+    int visits;
     Move m;
     int16_t size;
+    // Bitmask of the board symmetries that leave this node's position
+    // unchanged. Only one move of each symmetric set is expanded.
+    uint8_t symmetries;
     MCNode *parent;
     MCNode **children;
 
     MCNode() {
+        countStat(COUNT_NODE_ALLOCATIONS);
         numerator = 0;
         denominator = 1;
         scoreDiff = 0;
+        visits = 0;
         m = 0;
         size = 0;
+        symmetries = 1;
         parent = NULL;
         children = new MCNode *[512];
     }
@@ -47,8 +57,10 @@ struct MCTree {
         delete root;
     }
 
-    MCNode *findLeaf(Player &p, Board &b, int &depth);
-    void backPropagate(MCNode *leaf);
+    MCNode *findLeaf(Player &p, Board &b, int &depth, Rng &rng);
+    void backPropagate(MCNode *leaf, float n, int diff);
+    void addVirtualLoss(MCNode *leaf);
+    void removeVirtualLoss(MCNode *leaf);
 };
 
 #endif
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "board.h"
+#include "patterns.h"
+#include "rng.h"
+#include "search.h"
+#include "sgf.h"
+
+using namespace std;
+
+
+/*
+ * Micro-benchmarks for the board primitives: copying a board, doMove(),
+ * isMoveValid(), getLegalMoves(), countTerritory() and playRandomGame(). Each
+ * is timed on a set of positions, after a few warmup runs, over repeated
+ * runs, and the median and spread of the time per operation are reported.
+ *
+ * Usage: go-microbench [options] [files...]
+ *   --runs N       timed runs per measurement (default 15)
+ *   --warmup N     untimed runs before them (default 3)
+ *   --filter TEXT  only run primitives whose name contains TEXT
+ *   --csv          print comma separated values instead of a table
+ *
+ * Without files, the positions are the seeded ones of the benchmark command.
+ * Each SGF file given adds the positions a quarter, half, three quarters of
+ * the way through its moves, and at the end.
+ */
+
+extern int boardSize;
+extern int arraySize;
+extern Board game;
+extern uint64_t keyStack[4096];
+extern int keyStackSize;
+
+bool debugOutput = false;
+
+// Keeps results alive, so that the timed work is not optimized away
+volatile long sink;
+
+struct Position {
+    string name;
+    SgfGame record;
+    int moves;
+    // For generated positions
+    int size;
+    int phase;
+};
+
+struct Options {
+    int runs;
+    int warmup;
+    string filter;
+    bool csv;
+};
+
+// Sets up a position on the game board, and returns the player to move
+static Player setUpPosition(const Position &position) {
+    Player p = BLACK;
+    if (position.phase >= 0) {
+        setUpBenchmarkPosition(position.size, position.phase, p);
+        return p;
+    }
+
+    boardSize = position.record.boardSize;
+    arraySize = boardSize + 2;
+    game.reset();
+    keyStackSize = 0;
+    int played = replaySgf(position.record, position.moves, game, keyStack,
+        keyStackSize, 4096);
+    if (played < (int) position.record.colors.size())
+        p = position.record.colors[played];
+    else if (played > 0)
+        p = otherPlayer(position.record.colors[played-1]);
+    return p;
+}
+
+// Scales an iteration count for 9x9 down for larger boards
+static int scaled(int iterations) {
+    return max(10, iterations * 81 / (boardSize * boardSize));
+}
+
+// Times a function over the warmup and timed runs, and prints the median,
+// 10th and 90th percentile, and fastest time per operation in nanoseconds.
+// The function does one run, and returns the number of operations done.
+// Setup is called before every run, outside the timing.
+template <typename Setup, typename Function>
+static void measure(const Options &options, const string &primitive,
+        const string &position, Setup setup, Function run) {
+    if (primitive.find(options.filter) == string::npos)
+        return;
+
+    for (int i = 0; i < options.warmup; i++) {
+        setup();
+        run();
+    }
+    vector<double> times;
+    for (int i = 0; i < options.runs; i++) {
+        setup();
+        auto start = chrono::steady_clock::now();
+        long operations = run();
+        chrono::duration<double, nano> elapsed =
+            chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count() / max(1L, operations));
+    }
+    sort(times.begin(), times.end());
+    int n = times.size();
+    double median = times[n / 2];
+    double p10 = times[n / 10];
+    double p90 = times[(9 * n) / 10];
+
+    if (options.csv) {
+        printf("%s,%s,%d,%.1f,%.1f,%.1f,%.1f\n", primitive.c_str(),
+            position.c_str(), n, median, p10, p90, times[0]);
+    }
+    else {
+        printf("%-18s %-20s %12.1f %12.1f %12.1f %12.1f\n", primitive.c_str(),
+            position.c_str(), median, p10, p90, times[0]);
+    }
+    fflush(stdout);
+}
+
+static void benchmarkPosition(const Options &options, const Position &position) {
+    Player p = setUpPosition(position);
+    Rng rng(BENCHMARK_SEED);
+
+    // A sequence of legal moves from this position, and the finished board
+    // at the end of a playout, for the primitives that need them
+    Board finished(game);
+    playRandomGame(p, finished, rng);
+    vector<Move> sequence;
+    {
+        Board b(game);
+        Player q = p;
+        for (int i = 0; i < 50; i++) {
+            MoveList legalMoves = b.getLegalMoves(q);
+            Move m = MOVE_PASS;
+            while (legalMoves.size() > 0) {
+                int index = rng.bounded(legalMoves.size());
+                Move candidate = legalMoves.get(index);
+                legalMoves.removeFast(index);
+                if (b.isLegalNonEye(q, candidate)) {
+                    m = candidate;
+                    break;
+                }
+            }
+            if (m == MOVE_PASS)
+                break;
+            b.doMove(q, m);
+            sequence.push_back(m);
+            q = otherPlayer(q);
+        }
+    }
+
+    // Boards to play on are copied before each run, outside the timing
+    vector<Board *> copies;
+    auto makeCopies = [&](int count) {
+        for (unsigned int i = 0; i < copies.size(); i++)
+            delete copies[i];
+        copies.clear();
+        for (int i = 0; i < count; i++)
+            copies.push_back(new Board(game));
+    };
+    auto noSetup = []() {};
+
+    measure(options, "board_copy", position.name, noSetup, [&]() {
+        int iterations = scaled(2000);
+        for (int i = 0; i < iterations; i++) {
+            Board copy(game);
+            sink += copy.getCapturedStones(BLACK);
+        }
+        return (long) iterations;
+    });
+
+    measure(options, "do_move", position.name, [&]() { makeCopies(100); },
+        [&]() {
+        for (unsigned int i = 0; i < copies.size(); i++) {
+            Player q = p;
+            for (unsigned int j = 0; j < sequence.size(); j++) {
+                copies[i]->doMove(q, sequence[j]);
+                q = otherPlayer(q);
+            }
+        }
+        return (long) (copies.size() * max((size_t) 1, sequence.size()));
+    });
+
+    measure(options, "is_move_valid", position.name, noSetup, [&]() {
+        int iterations = scaled(20);
+        long valid = 0;
+        for (int i = 0; i < iterations; i++)
+            for (int y = 1; y <= boardSize; y++)
+                for (int x = 1; x <= boardSize; x++)
+                    valid += game.isMoveValid(BLACK, coordToMove(x, y))
+                           + game.isMoveValid(WHITE, coordToMove(x, y));
+        sink += valid;
+        return (long) iterations * boardSize * boardSize * 2;
+    });
+
+    measure(options, "get_legal_moves", position.name, noSetup, [&]() {
+        int iterations = scaled(1000);
+        for (int i = 0; i < iterations; i++)
+            sink += game.getLegalMoves(p).size();
+        return (long) iterations;
+    });
+
+    measure(options, "count_territory", position.name, noSetup, [&]() {
+        int iterations = scaled(1000);
+        for (int i = 0; i < iterations; i++) {
+            int whiteTerritory = 0, blackTerritory = 0;
+            finished.countTerritory(whiteTerritory, blackTerritory);
+            sink += whiteTerritory - blackTerritory;
+        }
+        return (long) iterations;
+    });
+
+    measure(options, "play_random_game", position.name,
+        [&]() { makeCopies(scaled(100)); }, [&]() {
+        for (unsigned int i = 0; i < copies.size(); i++)
+            sink += playRandomGame(p, *copies[i], rng);
+        return (long) copies.size();
+    });
+
+    for (unsigned int i = 0; i < copies.size(); i++)
+        delete copies[i];
+}
+
+int main(int argc, char **argv) {
+    initZobristTable();
+    initPatterns();
+
+    Options options;
+    options.runs = 15;
+    options.warmup = 3;
+    options.csv = false;
+    vector<Position> positions;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg == "--runs" && i+1 < argc)
+            options.runs = max(1, stoi(string(argv[++i])));
+        else if (arg == "--warmup" && i+1 < argc)
+            options.warmup = stoi(string(argv[++i]));
+        else if (arg == "--filter" && i+1 < argc)
+            options.filter = string(argv[++i]);
+        else if (arg == "--csv")
+            options.csv = true;
+        else {
+            Position position;
+            if (!loadSgf(arg, position.record) || position.record.boardSize < 3
+             || position.record.boardSize > 21) {
+                cerr << "Could not read " << arg << endl;
+                continue;
+            }
+            position.phase = -1;
+            int length = position.record.moves.size();
+            for (int quarter = 1; quarter <= 4; quarter++) {
+                position.moves = length * quarter / 4;
+                position.name = arg + ":" + to_string(position.moves);
+                positions.push_back(position);
+            }
+        }
+    }
+
+    if (positions.empty()) {
+        for (int s = 0; s < NUM_BENCHMARK_SIZES; s++) {
+            for (int phase = 0; phase < NUM_BENCHMARK_PHASES; phase++) {
+                Position position;
+                position.size = BENCHMARK_SIZES[s];
+                position.phase = phase;
+                position.name = to_string(position.size) + "x"
+                    + to_string(position.size) + " " + BENCHMARK_PHASES[phase];
+                positions.push_back(position);
+            }
+        }
+    }
+
+    if (options.csv)
+        printf("primitive,position,runs,median_ns,p10_ns,p90_ns,min_ns\n");
+    else {
+        printf("%-18s %-20s %12s %12s %12s %12s\n", "primitive", "position",
+            "median ns", "p10 ns", "p90 ns", "min ns");
+    }
+    for (unsigned int i = 0; i < positions.size(); i++)
+        benchmarkPosition(options, positions[i]);
+    return 0;
+}
@@ -0,0 +1,481 @@
+#include <fstream>
+#include <sstream>
+#include "ladder.h"
+#include "patterns.h"
+
+
+extern int boardSize;
+
+
+//------------------------------------------------------------------------------
+//--------------------------------Fenwick Tree----------------------------------
+//------------------------------------------------------------------------------
+
+// Sets up a tree for n points with all weights zero
+void FenwickTree::init(int n) {
+    size = 1;
+    while (size < n)
+        size <<= 1;
+    for (int i = 0; i < size; i++)
+        weights[i] = 0;
+    for (int i = 0; i <= size; i++)
+        tree[i] = 0;
+}
+
+// Rebuilds the tree from the weights array in O(n)
+void FenwickTree::build() {
+    tree[0] = 0;
+    for (int i = 1; i <= size; i++)
+        tree[i] = weights[i-1];
+    for (int i = 1; i <= size; i++) {
+        int parent = i + (i & -i);
+        if (parent <= size)
+            tree[parent] += tree[i];
+    }
+}
+
+void FenwickTree::set(int i, int w) {
+    int delta = w - weights[i];
+    if (delta == 0)
+        return;
+    weights[i] = w;
+    for (int j = i+1; j <= size; j += j & -j)
+        tree[j] += delta;
+}
+
+// Returns the point whose cumulative weight range contains r, for r < total()
+int FenwickTree::sample(unsigned int r) const {
+    int pos = 0;
+    for (int step = size; step > 0; step >>= 1) {
+        if (pos + step <= size && (unsigned int) tree[pos+step] <= r) {
+            pos += step;
+            r -= tree[pos];
+        }
+    }
+    return pos;
+}
+
+
+//------------------------------------------------------------------------------
+//-------------------------------Pattern Table----------------------------------
+//------------------------------------------------------------------------------
+/*
+ * A 3x3 pattern is encoded in 16 bits, 2 bits for each of the 8 neighbors of
+ * an empty point in the order NW, N, NE, W, E, SW, S, SE. Each neighbor is
+ * EMPTY (0), BLACK (1), WHITE (2) or off the board (3), which is just the
+ * Stone value masked with 3.
+ */
+const int NUM_PATTERNS = 1 << 16;
+const int NEIGHBOR_DX[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+const int NEIGHBOR_DY[8] = {1, 1, 1, 0, 0, -1, -1, -1};
+// The orthogonal neighbors N, W, E, S in the above order
+const int ORTHOGONAL[4] = {1, 3, 4, 6};
+
+// Pattern weights for each player to move, indexed by pattern code
+static uint16_t patternWeights[2][NUM_PATTERNS];
+
+// Weights of the tactical features, which are added on top of the pattern
+// weight of a point. A typical pattern weight is 10.
+const int CAPTURE_WEIGHT = 400;
+const int ESCAPE_WEIGHT = 200;
+const int PROXIMITY_WEIGHT = 10;
+
+// Whether escapes from atari are read out as ladders during playouts
+static bool playoutLadders = false;
+
+inline int neighborState(int code, int i) {
+    return (code >> (2*i)) & 3;
+}
+
+// Swaps black and white in a pattern code
+static int swapColors(int code) {
+    int result = 0;
+    for (int i = 0; i < 8; i++) {
+        int s = neighborState(code, i);
+        if (s == BLACK || s == WHITE)
+            s = 3 - s;
+        result |= s << (2*i);
+    }
+    return result;
+}
+
+// The default weights, for black to move. Own eyes are never played, moves
+// into the opponent's eyes (legal only as captures) and first line moves away
+// from any stones are discouraged, and contact moves are encouraged.
+static int defaultWeight(int code) {
+    bool ownEye = true;
+    bool opponentEye = true;
+    bool contact = false;
+    bool edge = false;
+    bool anyStone = false;
+    for (int i = 0; i < 4; i++) {
+        int s = neighborState(code, ORTHOGONAL[i]);
+        if (s != BLACK && s != 3)
+            ownEye = false;
+        if (s != WHITE && s != 3)
+            opponentEye = false;
+        if (s == WHITE)
+            contact = true;
+        if (s == 3)
+            edge = true;
+    }
+    for (int i = 0; i < 8; i++) {
+        int s = neighborState(code, i);
+        if (s == BLACK || s == WHITE)
+            anyStone = true;
+    }
+
+    if (ownEye)
+        return 0;
+    if (opponentEye)
+        return 1;
+    if (contact)
+        return 20;
+    if (edge && !anyStone)
+        return 3;
+    return 10;
+}
+
+static void setWeight(int blackCode, int weight) {
+    patternWeights[BLACK-1][blackCode] = weight;
+    patternWeights[WHITE-1][swapColors(blackCode)] = weight;
+}
+
+void initPatterns() {
+    for (int code = 0; code < NUM_PATTERNS; code++)
+        setWeight(code, defaultWeight(code));
+}
+
+// Sets the weight of every pattern matching a 3x3 template under all eight
+// symmetries. Returns false if the template is malformed.
+static bool addTemplate(const std::string &grid, int weight) {
+    if (grid.size() != 9)
+        return false;
+
+    for (int t = 0; t < 8; t++) {
+        // The neighbor states, with -1 for a wildcard
+        int states[8];
+        for (int i = 0; i < 8; i++) {
+            int dx = NEIGHBOR_DX[i];
+            int dy = NEIGHBOR_DY[i];
+            if (t & 1)
+                dx = -dx;
+            if (t & 2)
+                dy = -dy;
+            if (t & 4) {
+                int temp = dx;
+                dx = dy;
+                dy = temp;
+            }
+            // Rows are listed from the top, so dy = 1 is row 0
+            char c = grid[(1 - dy) * 3 + (dx + 1)];
+            switch (c) {
+                case '.': states[i] = EMPTY; break;
+                case 'X': states[i] = BLACK; break;
+                case 'O': states[i] = WHITE; break;
+                case '#': states[i] = 3; break;
+                case '?': states[i] = -1; break;
+                default: return false;
+            }
+        }
+
+        for (int code = 0; code < NUM_PATTERNS; code++) {
+            bool matches = true;
+            for (int i = 0; i < 8; i++) {
+                if (states[i] != -1 && states[i] != neighborState(code, i)) {
+                    matches = false;
+                    break;
+                }
+            }
+            if (matches)
+                setWeight(code, weight);
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Loads pattern weights from a file, on top of the defaults. Each line has a
+ * 3x3 template, written as 9 characters row by row from the top, and a weight
+ * from 0 to 65535. X is a stone of the player to move, O an opponent stone,
+ * . an empty point, # off the board and ? anything. The center is ignored.
+ * Templates apply in all orientations, and later lines override earlier ones.
+ * Blank lines and lines starting with ; are ignored.
+ */
+bool loadPatterns(const std::string &filename) {
+    std::ifstream in(filename.c_str());
+    if (!in)
+        return false;
+
+    std::string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == ';')
+            continue;
+        std::stringstream ss(line);
+        std::string grid;
+        int weight;
+        if (!(ss >> grid >> weight) || weight < 0 || weight > 65535)
+            return false;
+        if (!addTemplate(grid, weight))
+            return false;
+    }
+
+    return true;
+}
+
+void setPlayoutLadders(bool on) {
+    playoutLadders = on;
+}
+
+
+//------------------------------------------------------------------------------
+//------------------------------Pattern Playouts--------------------------------
+//------------------------------------------------------------------------------
+
+inline int pointIndex(int x, int y) {
+    return (x-1) + (y-1) * boardSize;
+}
+
+inline Move pointToMove(int i) {
+    return coordToMove(i % boardSize + 1, i / boardSize + 1);
+}
+
+static int patternCode(Board &b, int x, int y) {
+    int code = 0;
+    for (int i = 0; i < 8; i++)
+        code |= (b.getStone(x + NEIGHBOR_DX[i], y + NEIGHBOR_DY[i]) & 3) << (2*i);
+    return code;
+}
+
+// Recomputes the pattern weights of a single point for both players
+static void updatePoint(Board &b, FenwickTree *trees, int x, int y) {
+    if (x < 1 || x > boardSize || y < 1 || y > boardSize)
+        return;
+    int i = pointIndex(x, y);
+    if (b.getStone(x, y) != EMPTY || b.getSettledOwner(coordToMove(x, y))) {
+        trees[0].set(i, 0);
+        trees[1].set(i, 0);
+        return;
+    }
+    int code = patternCode(b, x, y);
+    trees[0].set(i, patternWeights[0][code]);
+    trees[1].set(i, patternWeights[1][code]);
+}
+
+// Updates every point whose 3x3 neighborhood contains (x, y)
+static void updateNeighborhood(Board &b, FenwickTree *trees, int x, int y) {
+    for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++)
+            updatePoint(b, trees, x+dx, y+dy);
+}
+
+static void buildTrees(Board &b, FenwickTree *trees) {
+    int points = boardSize * boardSize;
+    trees[0].init(points);
+    trees[1].init(points);
+    for (int y = 1; y <= boardSize; y++) {
+        for (int x = 1; x <= boardSize; x++) {
+            if (b.getStone(x, y) != EMPTY || b.getSettledOwner(coordToMove(x, y)))
+                continue;
+            int code = patternCode(b, x, y);
+            trees[0].weights[pointIndex(x, y)] = patternWeights[0][code];
+            trees[1].weights[pointIndex(x, y)] = patternWeights[1][code];
+        }
+    }
+    trees[0].build();
+    trees[1].build();
+}
+
+/*
+ * Plays a game to the end, choosing moves with probability proportional to
+ * their 3x3 pattern weight plus bonuses for capturing the last move's chain,
+ * escaping from atari, and playing next to the last move. Pattern weights
+ * are kept in one Fenwick tree per color, and after each move only the points
+ * around the changed stones are updated.
+ * The return value is the same as for playRandomGame().
+ */
+Player playPatternGame(Player p, Board &b, Rng &rng, int mercyThreshold) {
+    FenwickTree trees[2];
+    buildTrees(b, trees);
+
+    // Whether a player's tree has had weights zeroed for unplayable points,
+    // which may have become playable since
+    bool stale[2] = {false, false};
+    // Stacks for finding captured stones
+    Move region[FenwickTree::MAX_SIZE];
+    bool seen[FenwickTree::MAX_SIZE];
+
+    Move last = MOVE_PASS;
+    int passes = 0;
+    int maxMoves = 3 * boardSize * boardSize;
+    int startLead = b.getCaptureDifference(BLACK);
+
+    for (int moves = 0; moves < maxMoves && passes < 2; moves++) {
+        if (mercyThreshold) {
+            int lead = b.getCaptureDifference(BLACK) - startLead;
+            if (lead > mercyThreshold)
+                return BLACK;
+            if (-lead > mercyThreshold)
+                return WHITE;
+        }
+
+        FenwickTree &tree = trees[p-1];
+
+        // Tactical candidates around the last move, with their bonus weights
+        Move candidates[10];
+        int bonus[10];
+        int numCandidates = 0;
+        int bonusTotal = 0;
+        Move cap = MOVE_PASS;
+        if (last != MOVE_PASS) {
+            // Ko recaptures are rejected below like any other illegal move
+            cap = b.getPotentialCapture(last);
+            // Otherwise, capture any opponent chain left in atari
+            int ataris = b.getAtariCount(otherPlayer(p));
+            if (cap == MOVE_PASS && ataris > 0)
+                cap = b.getAtariLiberty(otherPlayer(p), rng.bounded(ataris));
+            if (cap != MOVE_PASS) {
+                candidates[numCandidates] = cap;
+                bonus[numCandidates] = CAPTURE_WEIGHT;
+                numCandidates++;
+            }
+            Move esc = b.getPotentialEscape(p, last);
+            // Only read the ladder out when there is an atari to escape from
+            if (esc != MOVE_PASS && playoutLadders)
+                esc = getLadderEscape(b, p, last);
+            if (esc != MOVE_PASS) {
+                candidates[numCandidates] = esc;
+                bonus[numCandidates] = ESCAPE_WEIGHT;
+                numCandidates++;
+            }
+            for (int i = 0; i < 8; i++) {
+                int nx = getX(last) + NEIGHBOR_DX[i];
+                int ny = getY(last) + NEIGHBOR_DY[i];
+                if (b.getStone(nx, ny) != EMPTY)
+                    continue;
+                if (tree.get(pointIndex(nx, ny)) == 0)
+                    continue;
+                candidates[numCandidates] = coordToMove(nx, ny);
+                bonus[numCandidates] = PROXIMITY_WEIGHT;
+                numCandidates++;
+            }
+            for (int i = 0; i < numCandidates; i++)
+                bonusTotal += bonus[i];
+        }
+
+        // Sample until we find a playable move, or run out of moves
+        Move m = MOVE_PASS;
+        bool rebuilt = false;
+        while (true) {
+            int total = tree.total() + bonusTotal;
+            if (total == 0) {
+                // Zeroed weights may be out of date, so rebuild once before
+                // giving up and passing
+                if (!stale[p-1] || rebuilt)
+                    break;
+                b.updateSettled();
+                buildTrees(b, trees);
+                stale[0] = stale[1] = false;
+                rebuilt = true;
+                continue;
+            }
+
+            unsigned int r = rng.bounded(total);
+            Move next;
+            if (r < (unsigned int) bonusTotal) {
+                int ci = 0;
+                while (r >= (unsigned int) bonus[ci]) {
+                    r -= bonus[ci];
+                    ci++;
+                }
+                next = candidates[ci];
+            }
+            else {
+                next = pointToMove(tree.sample(r - bonusTotal));
+            }
+
+            // Self-ataris are not played either, which is what keeps
+            // playouts from turning into long capture and refill sequences
+            if (b.isLegalNonEye(p, next) && !b.isSelfAtari(p, next)) {
+                m = next;
+                break;
+            }
+
+            // Not playable for now: drop it until its neighborhood changes
+            tree.set(pointIndex(getX(next), getY(next)), 0);
+            stale[p-1] = true;
+            for (int i = 0; i < numCandidates; i++) {
+                if (candidates[i] == next) {
+                    bonusTotal -= bonus[i];
+                    bonus[i] = 0;
+                }
+            }
+        }
+
+        if (m == MOVE_PASS) {
+            b.doMove(p, MOVE_PASS);
+            passes++;
+            last = MOVE_PASS;
+            p = otherPlayer(p);
+            continue;
+        }
+
+        int x = getX(m);
+        int y = getY(m);
+        Player victim = otherPlayer(p);
+        bool victimNeighbor[4];
+        for (int i = 0; i < 4; i++) {
+            int k = ORTHOGONAL[i];
+            victimNeighbor[i] = (b.getStone(x + NEIGHBOR_DX[k], y + NEIGHBOR_DY[k]) == victim);
+        }
+
+        b.doMove(p, m);
+        updateNeighborhood(b, trees, x, y);
+
+        // Find stones captured by the move. A captured chain had no liberties
+        // other than m, so the empty region it leaves behind is exactly the
+        // chain.
+        bool seenCleared = false;
+        for (int i = 0; i < 4; i++) {
+            int k = ORTHOGONAL[i];
+            int sx = x + NEIGHBOR_DX[k];
+            int sy = y + NEIGHBOR_DY[k];
+            if (!victimNeighbor[i] || b.getStone(sx, sy) != EMPTY)
+                continue;
+
+            if (!seenCleared) {
+                for (int j = 0; j < boardSize * boardSize; j++)
+                    seen[j] = false;
+                seenCleared = true;
+            }
+            if (seen[pointIndex(sx, sy)])
+                continue;
+
+            int top = 0;
+            region[top++] = coordToMove(sx, sy);
+            seen[pointIndex(sx, sy)] = true;
+            while (top > 0) {
+                Move c = region[--top];
+                int cx = getX(c);
+                int cy = getY(c);
+                updateNeighborhood(b, trees, cx, cy);
+                for (int d = 0; d < 4; d++) {
+                    int k2 = ORTHOGONAL[d];
+                    int nx = cx + NEIGHBOR_DX[k2];
+                    int ny = cy + NEIGHBOR_DY[k2];
+                    if (b.getStone(nx, ny) != EMPTY || seen[pointIndex(nx, ny)])
+                        continue;
+                    seen[pointIndex(nx, ny)] = true;
+                    region[top++] = coordToMove(nx, ny);
+                }
+            }
+        }
+
+        last = m;
+        passes = 0;
+        p = otherPlayer(p);
+    }
+
+    return EMPTY;
+}
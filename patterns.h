@@ -0,0 +1,36 @@
+#ifndef __PATTERNS_H__
+#define __PATTERNS_H__
+
+#include <string>
+#include "board.h"
+#include "rng.h"
+#include "types.h"
+
+/*
+ * A Fenwick (binary indexed) tree holding a sampling weight for each point of
+ * the board. Changing a weight and drawing a point with probability
+ * proportional to its weight are both O(log n). Storage is fixed size so that
+ * a playout never allocates.
+ */
+struct FenwickTree {
+    static const int MAX_SIZE = 1024;
+
+    // The number of leaves, rounded up to a power of two
+    int size;
+    int tree[MAX_SIZE + 1];
+    int weights[MAX_SIZE];
+
+    void init(int n);
+    void build();
+    void set(int i, int w);
+    int get(int i) const { return weights[i]; }
+    int total() const { return tree[size]; }
+    int sample(unsigned int r) const;
+};
+
+void initPatterns();
+bool loadPatterns(const std::string &filename);
+void setPlayoutLadders(bool on);
+Player playPatternGame(Player p, Board &b, Rng &rng, int mercyThreshold);
+
+#endif
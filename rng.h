@@ -0,0 +1,60 @@
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include "types.h"
+
+/*
+ * A small and fast pseudorandom number generator, xoshiro256** by David
+ * Blackman and Sebastiano Vigna. There is no global instance: each search
+ * thread owns one and passes it down to the tree and playout code.
+ */
+struct Rng {
+    uint64_t s[4];
+
+    Rng() {
+        seed(0);
+    }
+
+    Rng(uint64_t x) {
+        seed(x);
+    }
+
+    // Expands a 64-bit seed into the full state with splitmix64, which
+    // guarantees that the state is never all zero
+    void seed(uint64_t x) {
+        for (int i = 0; i < 4; i++) {
+            x += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            s[i] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Returns an integer uniformly distributed in [0, n), for n > 0. This is
+    // Lemire's multiply-shift reduction, which needs no division and no
+    // rejection loop. The bias is at most n / 2^32, which is negligible for
+    // the board sized ranges used here.
+    unsigned int bounded(unsigned int n) {
+        return (unsigned int) (((next() >> 32) * (uint64_t) n) >> 32);
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+#endif
@@ -1,11 +1,21 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <iostream>
-#include <random>
+#include <vector>
 #include "board.h"
+#include "book.h"
+#include "evaluator.h"
+#include "ladder.h"
 #include "mctree.h"
+#include "patterns.h"
+#include "rng.h"
 #include "search.h"
+#include "stats.h"
 
 
 struct HistoryTable {
@@ -67,14 +77,112 @@ int keyStackSize = 0;
 
 HistoryTable raveTable;
 
-std::default_random_engine rng(time(NULL));
+// Playouts end early once the capture difference exceeds this. 0 is off.
+int mercyThreshold = 0;
+// A limit in seconds on each search, on top of the playout count. 0 is off.
+double timeLimit = 0.0;
+// Whether playouts use the pattern policy instead of uniform random moves
+bool patternPlayouts = false;
+// Whether light playouts try the last good reply before a random move. Off
+// until a selfplay match shows that it does not weaken play.
+bool lastGoodReply = false;
+// The number of stop requests that have not been handled yet. While there
+// are any, searches end early.
+std::atomic<int> stopRequests(0);
+// Set while benchmarking, so that every search starts from scratch
+bool bypassCache = false;
+// Set once an explicit seed is given. Seeded searches skip the cache, which
+// would otherwise make their moves depend on earlier commands.
+bool seededSearch = false;
+
+// The generator for the search thread
+Rng searchRng(time(NULL));
+
+// Leaf evaluation. Random playouts are used until network weights are loaded.
+RolloutEvaluator rolloutEvaluator;
+LockstepEvaluator lockstepEvaluator;
+ConvNetEvaluator netEvaluator;
+MixedEvaluator mixedEvaluator(&rolloutEvaluator, &netEvaluator, 0.5);
+Evaluator *evaluator = &rolloutEvaluator;
+
+
+// Returns true if a child of node already plays m, or a move that is the same
+// as m under one of the node's symmetries
+static bool hasEquivalentChild(MCNode *node, Move m) {
+    for (int t = 0; t < NUM_SYMMETRIES; t++) {
+        if (!(node->symmetries & (1 << t)))
+            continue;
+        Move image = transformMove(m, t);
+        if (t > 0 && image == m)
+            continue;
+        for (int i = 0; i < node->size; i++)
+            if (node->children[i]->m == image)
+                return true;
+    }
+    return false;
+}
 
+// The symmetries of a position that remain after playing m
+static int symmetriesAfter(int symmetries, Move m) {
+    int result = 0;
+    for (int t = 0; t < NUM_SYMMETRIES; t++)
+        if ((symmetries & (1 << t)) && transformMove(m, t) == m)
+            result |= (1 << t);
+    return result;
+}
 
-void playRandomGame(Player p, Board &b);
-void scoreGame(Player p, Board &b, float &myScore, float &oppScore);
 
+static Move searchMove(Player p, Move lastMove, int maxPlayouts,
+    const AnalysisOptions *analysis);
+static void reportAnalysis(MCNode *root, const AnalysisOptions &analysis);
+static uint64_t getCacheKey(Player p);
+static void storeSearchStats(uint64_t key, MCNode *root, float komiSum,
+    int komiCount);
+static int restoreSearchStats(uint64_t key, MCNode *root, float &komiSum,
+    int &komiCount);
 
 Move generateMove(Player p, Move lastMove) {
+    // A book move is played without searching, if it is legal here
+    Move bookMove = probeBook(game, p, searchRng);
+    if (bookMove != MOVE_NULL && bookMove != MOVE_PASS
+     && game.isMoveValid(p, bookMove)) {
+        uint64_t newKey = game.getZobristKeyAfter(p, bookMove);
+        bool repeats = false;
+        for (int i = keyStackSize-1; i >= 0; i--)
+            repeats |= (keyStack[i] == newKey);
+        if (!repeats)
+            return bookMove;
+    }
+    return searchMove(p, lastMove, playouts, NULL);
+}
+
+// Searches with the given budget, without the opening book or the search
+// cache, so that the time taken is comparable between runs
+Move searchUncached(Player p, Move lastMove, int maxPlayouts) {
+    bypassCache = true;
+    Move m = searchMove(p, lastMove, maxPlayouts, NULL);
+    bypassCache = false;
+    return m;
+}
+
+// Searches until stopped, or until the tree holds maxPlayouts playouts, and
+// periodically hands the root statistics to the analysis callback
+void analyzePosition(Player p, Move lastMove, int maxPlayouts,
+    const AnalysisOptions &analysis) {
+    searchMove(p, lastMove, maxPlayouts, &analysis);
+}
+
+static Move searchMove(Player p, Move lastMove, int maxPlayouts,
+    const AnalysisOptions *analysis) {
+    // Statistics cover one search at a time
+    if (statsEnabled)
+        resetStats();
+    PhaseTimer timer(PHASE_SEARCH);
+
+    // Find settled areas once, so that every playout starts with them. The
+    // tree does not play in them either, so that they stay settled below it.
+    game.updateSettled();
+
     MoveList legalMoves = game.getLegalMoves(p);
     MoveList localMoves = game.getLocalMoves(lastMove);
 
@@ -82,17 +190,18 @@ Move generateMove(Player p, Move lastMove) {
     // a chain into atari
     bool playPass = true;
     for (unsigned int n = 0; n < legalMoves.size(); n++) {
-        Board copy = Board(game);
         Move m = legalMoves.get(n);
 
-        if (!copy.isMoveValid(otherPlayer(p), m) && copy.isEye(p, m))
+        if (game.getSettledOwner(m))
+            continue;
+
+        if (!game.isMoveValid(otherPlayer(p), m) && game.isEye(p, m))
             continue;
 
-        if (!copy.isMoveValid(p, m))
+        if (!game.isMoveValid(p, m))
             continue;
 
-        copy.doMove(p, m);
-        if (copy.isInAtari(m))
+        if (game.isSelfAtari(p, m))
             continue;
 
         playPass = false;
@@ -104,29 +213,37 @@ Move generateMove(Player p, Move lastMove) {
 
 
     MCTree searchTree;
-    float komiAdjustment = 0.0;
+    // In a symmetric position, such as an empty board or a handicap setup,
+    // only one move of each symmetric set is searched
+    searchTree.root->symmetries = game.getSymmetries();
     Move captureLastStone = game.getPotentialCapture(lastMove);
-    Move potentialEscape = game.getPotentialEscape(p, lastMove);
-
-    // Add all first-level moves
+    // Ladders are read out, so that escapes that only run into a ladder and
+    // ataris that start a working ladder are told apart
+    Move potentialEscape = getLadderEscape(game, p, lastMove);
+    Move ladderCapture = getLadderCapture(game, p, lastMove);
+
+    // Add all first-level moves. Children are only given their priors here,
+    // computed from the current position. Their first playout is done lazily
+    // by the main loop when the child is first selected.
     for (unsigned int n = 0; n < legalMoves.size(); n++) {
-        Board copy = Board(game);
         Player genPlayer = p;
 
         Move next = legalMoves.get(n);
         // Check legality of moves (suicide)
-        if (!copy.isMoveValid(genPlayer, next))
+        if (!game.isMoveValid(genPlayer, next))
+            continue;
+
+        if (game.getSettledOwner(next))
             continue;
 
-        copy.doMove(genPlayer, next);
         // Never place own chain in atari
-        if (copy.isInAtari(next))
+        if (game.isSelfAtari(genPlayer, next))
             continue;
 
         // Check for ko rule violation
         bool koViolation = false;
         if (next != MOVE_PASS) {
-            uint64_t newKey = copy.getZobristKey();
+            uint64_t newKey = game.getZobristKeyAfter(genPlayer, next);
             for (int i = keyStackSize-1; i >= 0; i--) {
                 if (newKey == keyStack[i]) {
                     koViolation = true;
@@ -139,28 +256,17 @@ Move generateMove(Player p, Move lastMove) {
 
         // First level moves are added to the root
         MCNode *leaf = searchTree.root;
+        if (hasEquivalentChild(leaf, next))
+            continue;
         MCNode *addition = new MCNode();
         addition->parent = leaf;
         addition->m = next;
-
-        // Play out a random game. The final board state will be stored in copy.
-        playRandomGame(otherPlayer(genPlayer), copy);
-
-        // Score the game
-        float myScore = 0.0, oppScore = 0.0;
-        scoreGame(genPlayer, copy, myScore, oppScore);
-        if (myScore > oppScore)
-            addition->numerator++;
-        addition->scoreDiff = ((int) myScore) - ((int) oppScore);
-        komiAdjustment += myScore - oppScore;
+        addition->symmetries = symmetriesAfter(leaf->symmetries, next);
 
         // Add the new node to the tree
         leaf->children[leaf->size] = addition;
         leaf->size++;
 
-        // Backpropagate the results
-        searchTree.backPropagate(addition);
-
         // Do priors, if any
         // Own eye and opening priors inspired by Pachi,
         // written by Petr Baudis and Jean-loup Gailly
@@ -227,6 +333,16 @@ Move generateMove(Player p, Move lastMove) {
             addition->numerator += 5 * basePrior;
             addition->denominator += 5 * basePrior;
         }
+        else {
+            // Add a smaller bonus for capturing any other chain in atari
+            for (int i = 0; i < game.getAtariCount(otherPlayer(p)); i++) {
+                if (next == game.getAtariLiberty(otherPlayer(p), i)) {
+                    addition->numerator += 2 * basePrior;
+                    addition->denominator += 2 * basePrior;
+                    break;
+                }
+            }
+        }
 
         // Add a bonus for escaping when the opponent's last move
         // placed our chain into atari
@@ -235,6 +351,12 @@ Move generateMove(Player p, Move lastMove) {
             addition->denominator += 5 * basePrior;
         }
 
+        // Add a bonus for catching the opponent's last move in a ladder
+        if (next == ladderCapture) {
+            addition->numerator += 5 * basePrior;
+            addition->denominator += 5 * basePrior;
+        }
+
         // Add a bonus to local moves
         if (legalMoves.size() < openingMoves) {
             int li = localMoves.find(next);
@@ -252,90 +374,188 @@ Move generateMove(Player p, Move lastMove) {
     if (searchTree.root->size == 0)
         return MOVE_PASS;
 
-    // Calculate an estimate of a komi adjustment
-    komiAdjustment /= legalMoves.size();
-
-
-    // Expand the MC tree iteratively
-    for (int n = 0; n < playouts; n++) {
-        Board copy = Board(game);
-        Player genPlayer = p;
+    // An estimate of a komi adjustment, averaged over the first playouts of
+    // the root children
+    float komiAdjustment = 0.0;
+    float komiSum = 0.0;
+    int komiCount = 0;
+
+    // Statistics left from an earlier search of this position count towards
+    // the playout budget
+    uint64_t cacheKey = getCacheKey(p);
+    bool useCache = !bypassCache && !seededSearch;
+    int n = useCache
+        ? restoreSearchStats(cacheKey, searchTree.root, komiSum, komiCount) : 0;
+    if (komiCount > 0)
+        komiAdjustment = komiSum / komiCount;
+
+
+    // Expand the MC tree iteratively. Leaves are queued up with virtual loss
+    // and handed to the evaluator in batches.
+    int batchSize = evaluator->batchSize();
+    EvalRequest *batch = new EvalRequest[batchSize];
+    MCNode **batchNodes = new MCNode *[batchSize];
+    int *batchDepths = new int[batchSize];
+
+    // Analysis reports are made between batches, on the search thread. They
+    // only read the root's children and the principal variations.
+    std::chrono::steady_clock::time_point startTime =
+        std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point nextReport = startTime;
+    if (analysis)
+        nextReport += std::chrono::milliseconds(analysis->intervalMs);
+
+    while (n < maxPlayouts && !isSearchStopped()) {
+        if (analysis || timeLimit > 0.0) {
+            std::chrono::steady_clock::time_point now =
+                std::chrono::steady_clock::now();
+            if (analysis && now >= nextReport) {
+                reportAnalysis(searchTree.root, *analysis);
+                nextReport += std::chrono::milliseconds(analysis->intervalMs);
+            }
+            std::chrono::duration<double> elapsed = now - startTime;
+            if (timeLimit > 0.0 && elapsed.count() >= timeLimit)
+                break;
+        }
 
-        // Find a node in the tree to add a child to
-        int depth = -1;
-        MCNode *leaf = searchTree.findLeaf(genPlayer, copy, depth);
+        int batchCount = 0;
+        while (batchCount < batchSize && n < maxPlayouts) {
+            n++;
+            Board *copy = new Board(game);
+            Player genPlayer = p;
+
+            // Find a node in the tree to add a child to
+            int depth = -1;
+            MCNode *leaf = searchTree.findLeaf(genPlayer, *copy, depth, searchRng);
+            PhaseTimer expansionTimer(PHASE_EXPANSION);
+
+            EvalRequest &req = batch[batchCount];
+            req.board = copy;
+
+            // The first visit to a root child evaluates the child itself
+            if (depth == 0 && leaf->visits == 0) {
+                req.toMove = genPlayer;
+                req.bias = 0.0;
+                batchNodes[batchCount] = leaf;
+                batchDepths[batchCount] = -1;
+                searchTree.addVirtualLoss(leaf);
+                batchCount++;
+                continue;
+            }
 
-        MCNode *addition = new MCNode();
-        addition->parent = leaf;
-        MoveList candidates = copy.getLegalMoves(genPlayer);
-        candidates.add(MOVE_PASS);
-
-        // Set up a permutation matrix
-        int *permutation = new int[candidates.size()];
-        // Fisher-Yates shuffle
-        for (unsigned int i = 0; i < candidates.size(); i++) {
-            std::uniform_int_distribution<int> distribution(0, i);
-            int j = distribution(rng);
-            permutation[i] = permutation[j];
-            permutation[j] = i;
-        }
+            MoveList candidates = copy->getLegalMoves(genPlayer);
+            candidates.add(MOVE_PASS);
 
-        // Find a random move that has not been explored yet
-        Move next = 0;
-        for (unsigned int i = 0; i < candidates.size(); i++) {
-            next = candidates.get(permutation[i]);
+            // Set up a permutation matrix
+            int *permutation = new int[candidates.size()];
+            // Fisher-Yates shuffle
+            for (unsigned int i = 0; i < candidates.size(); i++) {
+                int j = searchRng.bounded(i + 1);
+                permutation[i] = permutation[j];
+                permutation[j] = i;
+            }
 
-            bool used = false;
-            for (int j = 0; j < leaf->size; j++) {
-                if (next == leaf->children[j]->m) {
-                    used = true;
+            // Find a random move that has not been explored yet
+            Move next = 0;
+            bool found = false;
+            for (unsigned int i = 0; i < candidates.size(); i++) {
+                next = candidates.get(permutation[i]);
+                if (!hasEquivalentChild(leaf, next)
+                 && copy->isMoveValid(genPlayer, next)
+                 && (next == MOVE_PASS || !copy->getSettledOwner(next))) {
+                    found = true;
                     break;
                 }
             }
 
-            if (!used && copy.isMoveValid(genPlayer, next))
-                break;
-        }
-
-        delete[] permutation;
-
-        addition->m = next;
-        copy.doMove(genPlayer, next);
-
-        // Play out a random game. The final board state will be stored in copy.
-        playRandomGame(otherPlayer(genPlayer), copy);
+            delete[] permutation;
+
+            // Every move of a symmetric position may already be expanded. The
+            // leaf is then evaluated again instead, as a visit of its own.
+            if (!found && leaf->symmetries != 1) {
+                leaf->denominator++;
+                req.toMove = genPlayer;
+                req.bias = (genPlayer == p) ? -komiAdjustment : komiAdjustment;
+                batchNodes[batchCount] = leaf;
+                batchDepths[batchCount] = depth;
+                searchTree.addVirtualLoss(leaf);
+                batchCount++;
+                continue;
+            }
 
-        // Score the game... somehow...
-        float myScore = 0.0, oppScore = 0.0;
-        scoreGame(genPlayer, copy, myScore, oppScore);
-        myScore += (genPlayer == p) ? -komiAdjustment : komiAdjustment;
+            MCNode *addition = new MCNode();
+            addition->parent = leaf;
+            addition->m = next;
+            addition->symmetries = symmetriesAfter(leaf->symmetries, next);
+            copy->doMove(genPlayer, next);
+
+            // Add the new node to the tree now so that other descents in this
+            // batch see it
+            leaf->children[leaf->size] = addition;
+            leaf->size++;
+
+            req.toMove = otherPlayer(genPlayer);
+            req.bias = (genPlayer == p) ? komiAdjustment : -komiAdjustment;
+            batchNodes[batchCount] = addition;
+            batchDepths[batchCount] = depth;
+            searchTree.addVirtualLoss(addition);
+            batchCount++;
+        }
 
-        if (myScore > oppScore) {
-            addition->numerator++;
+        evaluator->evaluate(batch, batchCount, searchRng);
+
+        for (int i = 0; i < batchCount; i++) {
+            MCNode *node = batchNodes[i];
+            int depth = batchDepths[i];
+            float value = batch[i].value;
+            int scoreDiff = (int) (batch[i].score - batch[i].bias);
+            searchTree.removeVirtualLoss(node);
+
+            // A first visit to a root child, which also feeds the komi
+            // adjustment estimate
+            if (depth == -1) {
+                komiSum += batch[i].score;
+                komiCount++;
+                komiAdjustment = komiSum / komiCount;
+            }
             // If the node is not a child of root
-            if (depth)
-                raveTable.inc(next, depth);
-        }
-        else {
-            if (depth)
-                raveTable.dec(next, depth);
-        }
-        addition->scoreDiff = ((int) myScore) - ((int) oppScore);
+            else if (depth) {
+                if (value > 0.5)
+                    raveTable.inc(node->m, depth);
+                else
+                    raveTable.dec(node->m, depth);
+            }
 
-        // Add the new node to the tree
-        leaf->children[leaf->size] = addition;
-        leaf->size++;
+            node->numerator += value;
+            node->scoreDiff += scoreDiff;
 
-        // Backpropagate the results
-        searchTree.backPropagate(addition);
+            // Backpropagate the results
+            searchTree.backPropagate(node, value, scoreDiff);
+            delete batch[i].board;
+        }
     }
 
+    delete[] batch;
+    delete[] batchNodes;
+    delete[] batchDepths;
+
+    if (analysis)
+        reportAnalysis(searchTree.root, *analysis);
+    if (useCache)
+        storeSearchStats(cacheKey, searchTree.root, komiSum, komiCount);
 
     // Find the highest scoring move
     Move bestMove = searchTree.root->children[0]->m;
     double bestScore = 0.0;
     int64_t diff = -(1 << 30);
     int maxRAVE = raveTable.max();
+    // With a small playout budget some children may only have priors. Only
+    // consider children that were actually played out, if there are any.
+    bool anyVisited = false;
+    for (int i = 0; i < searchTree.root->size; i++)
+        if (searchTree.root->children[i]->visits > 0)
+            anyVisited = true;
+
     for (int i = 0; i < searchTree.root->size; i++) {
         double candidateScore = (double) searchTree.root->children[i]->numerator
                               / (double) searchTree.root->children[i]->denominator;
@@ -357,6 +577,9 @@ Move generateMove(Player p, Move lastMove) {
                       << searchTree.root->children[i]->denominator << std::endl;
         }
 
+        if (anyVisited && searchTree.root->children[i]->visits == 0)
+            continue;
+
         if (candidateScore > bestScore
          || (candidateScore == bestScore && searchTree.root->children[i]->scoreDiff > diff)) {
             bestScore = candidateScore;
@@ -371,61 +594,452 @@ Move generateMove(Player p, Move lastMove) {
 }
 
 
+// Collects the most visited root moves, with their principal variations, and
+// passes them to the analysis callback
+static void reportAnalysis(MCNode *root, const AnalysisOptions &analysis) {
+    std::vector<AnalysisMove> moves;
+    for (int i = 0; i < root->size; i++) {
+        MCNode *child = root->children[i];
+        if (child->visits == 0)
+            continue;
+        AnalysisMove a;
+        a.m = child->m;
+        a.visits = child->visits;
+        a.winrate = child->numerator / child->denominator;
+        a.scoreLead = (float) child->scoreDiff / child->visits;
+        moves.push_back(a);
+    }
+    std::sort(moves.begin(), moves.end(),
+        [](const AnalysisMove &a, const AnalysisMove &b) {
+            return a.visits > b.visits;
+        });
+    if (moves.empty())
+        return;
+    if ((int) moves.size() > analysis.maxMoves)
+        moves.resize(analysis.maxMoves);
+
+    // Each principal variation follows the most visited child
+    for (unsigned int i = 0; i < moves.size(); i++) {
+        MCNode *node = NULL;
+        for (int j = 0; j < root->size; j++)
+            if (root->children[j]->m == moves[i].m)
+                node = root->children[j];
+        while (node != NULL) {
+            moves[i].pv.push_back(node->m);
+            MCNode *next = NULL;
+            for (int j = 0; j < node->size; j++)
+                if (node->children[j]->visits > 0
+                 && (next == NULL || node->children[j]->visits > next->visits))
+                    next = node->children[j];
+            node = next;
+        }
+    }
+
+    analysis.callback(moves);
+}
+
+
+//------------------------------------------------------------------------------
+//-------------------------------Search Cache-----------------------------------
+//------------------------------------------------------------------------------
+/*
+ * The root statistics of recently searched positions, keyed by position,
+ * side to move, board size, komi, captures, ko and the superko history. A
+ * search of a cached position starts from the stored statistics instead of
+ * from scratch, so analysis followed by genmove, or a genmove reissued after
+ * a restart, does not repeat work.
+ *
+ * The cache outlives clear_board, and can be written to disk and read back,
+ * so that a restarted engine resumes where it left off. Searches with an
+ * explicit seed neither read nor write it, so that they stay reproducible.
+ * The file is a header, then the positions, then the children of every
+ * position, each written and read as a single block.
+ */
+const int MAX_CACHED_POSITIONS = 512;
+const char CACHE_MAGIC[8] = {'G', 'O', 'C', 'A', 'C', 'H', 'E', '2'};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t positionCount;
+    uint32_t childCount;
+};
+
+struct CachedPosition {
+    uint64_t key;
+    uint32_t firstChild;
+    uint32_t childCount;
+    float komiSum;
+    int32_t komiCount;
+    // The root's own statistics
+    float numerator;
+    int32_t denominator;
+    int32_t visits;
+    int32_t reserved;
+    int64_t scoreDiff;
+};
+
+struct CachedChild {
+    Move m;
+    uint16_t reserved;
+    int32_t denominator;
+    float numerator;
+    int32_t visits;
+    int64_t scoreDiff;
+};
+
+// Positions from oldest to newest. Each position's children are a contiguous
+// range of cachedChildren, in the same order.
+static std::vector<CachedPosition> cachedPositions;
+static std::vector<CachedChild> cachedChildren;
+
+// Covers everything the search's result depends on: the stones, board size,
+// komi, captures, which count towards the score, the ko point, and the
+// earlier positions that superko forbids repeating
+static uint64_t getCacheKey(Player p) {
+    uint64_t blackCaptures = game.getCapturedStones(BLACK) + 1;
+    uint64_t whiteCaptures = game.getCapturedStones(WHITE) + 1;
+    uint64_t history = 0;
+    for (int i = 0; i < keyStackSize; i++)
+        history ^= keyStack[i];
+    uint64_t key = game.getZobristKey() ^ (0x9E3779B97F4A7C15ULL * boardSize)
+        ^ (0xFF51AFD7ED558CCDULL * (uint64_t) (int64_t) (2 * komi))
+        ^ (0xC4CEB9FE1A85EC53ULL * blackCaptures)
+        ^ (0x27D4EB2F165667C5ULL * whiteCaptures)
+        ^ (0x165667B19E3779F9ULL * (uint64_t) game.getKoPoint(p))
+        ^ ((history ^ (history >> 29)) * 0xBF58476D1CE4E5B9ULL);
+    if (p == WHITE)
+        key ^= 0xC2B2AE3D27D4EB4FULL;
+    return key;
+}
+
+static int findCachedPosition(uint64_t key) {
+    for (int i = (int) cachedPositions.size() - 1; i >= 0; i--)
+        if (cachedPositions[i].key == key)
+            return i;
+    return -1;
+}
+
+static void eraseCachedPosition(int index) {
+    CachedPosition erased = cachedPositions[index];
+    cachedChildren.erase(cachedChildren.begin() + erased.firstChild,
+        cachedChildren.begin() + erased.firstChild + erased.childCount);
+    cachedPositions.erase(cachedPositions.begin() + index);
+    for (unsigned int i = index; i < cachedPositions.size(); i++)
+        cachedPositions[i].firstChild -= erased.childCount;
+}
+
+// Stores the statistics of the root and its played out children, replacing
+// any older entry for the position
+static void storeSearchStats(uint64_t key, MCNode *root, float komiSum,
+        int komiCount) {
+    int old = findCachedPosition(key);
+    if (old != -1)
+        eraseCachedPosition(old);
+    if ((int) cachedPositions.size() >= MAX_CACHED_POSITIONS)
+        eraseCachedPosition(0);
+
+    CachedPosition position;
+    position.key = key;
+    position.firstChild = cachedChildren.size();
+    position.childCount = 0;
+    position.komiSum = komiSum;
+    position.komiCount = komiCount;
+    position.numerator = root->numerator;
+    position.denominator = root->denominator;
+    position.visits = root->visits;
+    position.reserved = 0;
+    position.scoreDiff = root->scoreDiff;
+    for (int i = 0; i < root->size; i++) {
+        MCNode *node = root->children[i];
+        if (node->visits == 0)
+            continue;
+        CachedChild child;
+        child.m = node->m;
+        child.reserved = 0;
+        child.denominator = node->denominator;
+        child.numerator = node->numerator;
+        child.visits = node->visits;
+        child.scoreDiff = node->scoreDiff;
+        cachedChildren.push_back(child);
+        position.childCount++;
+    }
+    cachedPositions.push_back(position);
+}
+
+// Copies cached statistics onto a freshly expanded root, for the children it
+// still has. Returns the number of playouts restored.
+static int restoreSearchStats(uint64_t key, MCNode *root, float &komiSum,
+        int &komiCount) {
+    int index = findCachedPosition(key);
+    if (index == -1)
+        return 0;
+
+    const CachedPosition &position = cachedPositions[index];
+    komiSum = position.komiSum;
+    komiCount = position.komiCount;
+    root->numerator = position.numerator;
+    root->denominator = position.denominator;
+    root->visits = position.visits;
+    root->scoreDiff = position.scoreDiff;
+    for (uint32_t c = 0; c < position.childCount; c++) {
+        const CachedChild &child = cachedChildren[position.firstChild + c];
+        for (int i = 0; i < root->size; i++) {
+            MCNode *node = root->children[i];
+            if (node->m != child.m)
+                continue;
+            node->numerator = child.numerator;
+            node->denominator = child.denominator;
+            node->visits = child.visits;
+            node->scoreDiff = child.scoreDiff;
+            break;
+        }
+    }
+    return position.visits;
+}
+
+// Writes the cache to a file. The file is replaced in one step, so that a
+// crash while writing leaves the previous file intact.
+bool saveSearchCache(const std::string &filename) {
+    std::string temporary = filename + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == NULL)
+        return false;
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.positionCount = cachedPositions.size();
+    header.childCount = cachedChildren.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(cachedPositions.data(), sizeof(CachedPosition),
+            cachedPositions.size(), file) == cachedPositions.size()
+        && fwrite(cachedChildren.data(), sizeof(CachedChild),
+            cachedChildren.size(), file) == cachedChildren.size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), filename.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Replaces the cache with the contents of a file. Returns false, leaving the
+// cache as it was, if the file can't be read or is not a cache file.
+bool loadSearchCache(const std::string &filename) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        fileSize = ftell(file);
+        rewind(file);
+    }
+
+    // The counts must account for the file's size exactly, before anything is
+    // allocated for them
+    CacheHeader header;
+    std::vector<CachedPosition> positions;
+    std::vector<CachedChild> children;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+        && (uint64_t) fileSize == sizeof(header)
+            + (uint64_t) header.positionCount * sizeof(CachedPosition)
+            + (uint64_t) header.childCount * sizeof(CachedChild);
+    if (ok) {
+        positions.resize(header.positionCount);
+        children.resize(header.childCount);
+        ok = fread(positions.data(), sizeof(CachedPosition), positions.size(),
+                file) == positions.size()
+            && fread(children.data(), sizeof(CachedChild), children.size(),
+                file) == children.size();
+    }
+    fclose(file);
+
+    // The positions' children must follow each other in order, and cover
+    // every child in the file
+    uint64_t nextChild = 0;
+    for (unsigned int i = 0; ok && i < positions.size(); i++) {
+        ok = positions[i].firstChild == nextChild;
+        nextChild += positions[i].childCount;
+    }
+    if (!ok || nextChild != children.size())
+        return false;
+
+    cachedPositions.swap(positions);
+    cachedChildren.swap(children);
+    while ((int) cachedPositions.size() > MAX_CACHED_POSITIONS)
+        eraseCachedPosition(0);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+//--------------------------Last Good Reply Policy------------------------------
+//------------------------------------------------------------------------------
+/*
+ * Last good reply with forgetting. After each playout, every move by the
+ * winner is stored as the reply to the move before it, and to the two moves
+ * before it. Every move by the loser is removed from the table if it is the
+ * stored reply. Entries are single moves, so the tables are shared between
+ * threads without locks: a racing update at worst loses a reply.
+ */
+const int REPLY_POINTS = 27 * 27;
+const int REPLY2_BITS = 16;
+
+// Indexed by the color to reply and the previous move
+std::atomic<uint16_t> replyTable[2][REPLY_POINTS];
+// Indexed by the color to reply and a hash of the previous two moves
+std::atomic<uint16_t> reply2Table[2][1 << REPLY2_BITS];
+
+// The moves of this thread's last light playout
+struct PlayoutRecord {
+    Move moves[3 * REPLY_POINTS];
+    int length;
+    Player first;
+};
+
+static thread_local PlayoutRecord playoutRecord;
+
+inline int replyIndex(Move m) {
+    return (m == MOVE_PASS) ? 0 : getX(m) + getY(m) * arraySize;
+}
+
+inline int reply2Index(Move prev2, Move prev) {
+    uint32_t key = replyIndex(prev2) * REPLY_POINTS + replyIndex(prev);
+    return (key * 2654435761u) >> (32 - REPLY2_BITS);
+}
+
+// Returns the stored reply for p to the last two moves, or MOVE_NULL
+Move getLastGoodReply(Player p, Move prev2, Move prev) {
+    Move reply = reply2Table[p-1][reply2Index(prev2, prev)]
+        .load(std::memory_order_relaxed);
+    if (reply == MOVE_NULL)
+        reply = replyTable[p-1][replyIndex(prev)].load(std::memory_order_relaxed);
+    return reply;
+}
+
+static void storeReply(std::atomic<uint16_t> &entry, Move reply, bool won) {
+    if (won)
+        entry.store(reply, std::memory_order_relaxed);
+    else {
+        uint16_t expected = reply;
+        entry.compare_exchange_strong(expected, MOVE_NULL,
+            std::memory_order_relaxed);
+    }
+}
+
+// Updates the reply tables with the moves of this thread's last light
+// playout, which was won by winner
+void updateLastGoodReplies(Player winner) {
+    PlayoutRecord &r = playoutRecord;
+    Player p = otherPlayer(r.first);
+    for (int i = 1; i < r.length; i++) {
+        Move prev2 = (i >= 2) ? r.moves[i-2] : MOVE_PASS;
+        Move prev = r.moves[i-1];
+        Move reply = r.moves[i];
+        storeReply(replyTable[p-1][replyIndex(prev)], reply, p == winner);
+        storeReply(reply2Table[p-1][reply2Index(prev2, prev)], reply,
+            p == winner);
+        p = otherPlayer(p);
+    }
+    r.length = 0;
+}
+
+static void clearLastGoodReplies() {
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < REPLY_POINTS; i++)
+            replyTable[c][i].store(MOVE_NULL, std::memory_order_relaxed);
+        for (int i = 0; i < (1 << REPLY2_BITS); i++)
+            reply2Table[c][i].store(MOVE_NULL, std::memory_order_relaxed);
+    }
+}
+
+
 //------------------------------------------------------------------------------
 //-------------------------------MCTS Methods-----------------------------------
 //------------------------------------------------------------------------------
-void playRandomGame(Player p, Board &b) {
+// Plays random moves until the game is over. If one side captures more than
+// the mercy threshold of stones more than the other during the playout, the
+// game is stopped early and that side is returned as the winner. Otherwise
+// returns EMPTY, and the final board state should be scored.
+Player playRandomGame(Player p, Board &b, Rng &rng) {
+    PhaseTimer timer(PHASE_PLAYOUT);
+    PlayoutRecord &record = playoutRecord;
+    record.length = 0;
+    record.first = p;
+    if (patternPlayouts)
+        return playPatternGame(p, b, rng, mercyThreshold);
+
     int movesPlayed = 1;
     int i = 0;
     Move last = MOVE_PASS;
+    Move prev = MOVE_PASS;
+    // Several kos can still be retaken in a cycle, so the game length is
+    // capped as well
+    int movesLeft = 3 * boardSize * boardSize;
+    // Captures made before the playout count towards the score, but not
+    // towards the mercy rule
+    int startLead = b.getCaptureDifference(BLACK);
 
     // Regenerate the movelist up to 4 times
     while (movesPlayed > 0 && i < 4) {
         movesPlayed = 0;
         i++;
         MoveList legalMoves = b.getLegalMoves(p);
-        int koCount = 0;
 
         // While we still have legal moves remaining
-        while (legalMoves.size() > 0) {
-            // Check if the last move put its own chain into atari
-            // Do not do this twice in a row to prevent infinite ko recapture
-            if (koCount == 0) {
-                Move cap = b.getPotentialCapture(last);
-                if (cap != MOVE_PASS) {
-                    int ci = legalMoves.find(cap);
-                    if (ci != -1)
-                        legalMoves.removeFast(ci);
-                    
-                    b.doMove(p, cap);
-                    last = cap;
-                    p = otherPlayer(p);
-                    movesPlayed++;
-                    koCount++;
-                    continue;
-                }
+        while (legalMoves.size() > 0 && movesLeft > 0) {
+            if (mercyThreshold) {
+                int lead = b.getCaptureDifference(BLACK) - startLead;
+                if (lead > mercyThreshold)
+                    return BLACK;
+                if (-lead > mercyThreshold)
+                    return WHITE;
             }
 
-            // Otherwise, pick a move at random
-            std::uniform_int_distribution<int> distribution(0, legalMoves.size()-1);
-            int index = distribution(rng);
-            Move m = legalMoves.get(index);
-
-            // Only play moves that are not into own eyes and not suicides
-            if (!b.isEye(p, m) && b.isMoveValid(p, m)) {
-                b.doMove(p, m);
-                last = m;
-                p = otherPlayer(p);
-                movesPlayed++;
-                koCount = 0;
+            // Check if the last move put its own chain into atari, or if any
+            // other opponent chain is left in atari
+            Move m = b.getPotentialCapture(last);
+            int ataris = b.getAtariCount(otherPlayer(p));
+            if (m == MOVE_PASS && ataris > 0)
+                m = b.getAtariLiberty(otherPlayer(p), rng.bounded(ataris));
+            // Immediate ko recaptures are illegal
+            if (m != MOVE_PASS && !b.isMoveValid(p, m))
+                m = MOVE_PASS;
+
+            // Then the reply that last won a playout
+            if (m == MOVE_PASS && lastGoodReply) {
+                m = getLastGoodReply(p, prev, last);
+                if (m != MOVE_NULL && !b.isLegalNonEye(p, m))
+                    m = MOVE_NULL;
             }
 
-            legalMoves.removeFast(index);
+            // Otherwise, pick a move at random. Played moves stay in the
+            // list, and are dropped when they are picked.
+            if (m == MOVE_PASS || m == MOVE_NULL) {
+                int index = rng.bounded(legalMoves.size());
+                m = legalMoves.get(index);
+                legalMoves.removeFast(index);
+
+                // Only play moves that are not into own eyes and not suicides
+                if (!b.isLegalNonEye(p, m))
+                    continue;
+            }
+
+            b.doMove(p, m);
+            record.moves[record.length++] = m;
+            prev = last;
+            last = m;
+            p = otherPlayer(p);
+            movesPlayed++;
+            movesLeft--;
         }
     }
+
+    return EMPTY;
 }
 
 void scoreGame(Player p, Board &b, float &myScore, float &oppScore) {
+    PhaseTimer timer(PHASE_SCORING);
     int whiteTerritory = 0, blackTerritory = 0;
     b.countTerritory(whiteTerritory, blackTerritory);
 
@@ -446,4 +1060,111 @@ void scoreGame(Player p, Board &b, float &myScore, float &oppScore) {
 //------------------------------------------------------------------------------
 void resetSearchState() {
     raveTable.reset();
+    clearLastGoodReplies();
+}
+
+// A copy of the state that carries over between the moves of a game, for
+// commands that search positions of their own in the middle of one
+struct SavedSearchState {
+    HistoryTable rave;
+    uint16_t replies[2][REPLY_POINTS];
+    uint16_t replies2[2][1 << REPLY2_BITS];
+    Rng rng;
+    bool seeded;
+};
+
+static SavedSearchState savedSearchState;
+
+void saveSearchState() {
+    SavedSearchState &s = savedSearchState;
+    s.rave = raveTable;
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < REPLY_POINTS; i++)
+            s.replies[c][i] = replyTable[c][i].load(std::memory_order_relaxed);
+        for (int i = 0; i < (1 << REPLY2_BITS); i++) {
+            s.replies2[c][i] =
+                reply2Table[c][i].load(std::memory_order_relaxed);
+        }
+    }
+    s.rng = searchRng;
+    s.seeded = seededSearch;
+}
+
+void restoreSearchState() {
+    SavedSearchState &s = savedSearchState;
+    raveTable = s.rave;
+    for (int c = 0; c < 2; c++) {
+        for (int i = 0; i < REPLY_POINTS; i++)
+            replyTable[c][i].store(s.replies[c][i], std::memory_order_relaxed);
+        for (int i = 0; i < (1 << REPLY2_BITS); i++) {
+            reply2Table[c][i].store(s.replies2[c][i],
+                std::memory_order_relaxed);
+        }
+    }
+    searchRng = s.rng;
+    seededSearch = s.seeded;
+}
+
+// Loads value network weights and starts using the network for leaf
+// evaluation. Returns false if the weights could not be loaded.
+bool loadNetWeights(const std::string &filename) {
+    if (!netEvaluator.load(filename))
+        return false;
+    evaluator = &mixedEvaluator;
+    return true;
+}
+
+// Sets the weight of the value network relative to random playouts, from 0
+// (playouts only) to 1 (network only).
+void setNetWeight(float weight) {
+    mixedEvaluator.weight = weight;
+}
+
+void setTimeLimit(double seconds) {
+    timeLimit = seconds;
+}
+
+void setMercyThreshold(int threshold) {
+    mercyThreshold = threshold;
+}
+
+void setPatternPlayouts(bool enabled) {
+    patternPlayouts = enabled;
+}
+
+// Makes the current search, and every search started before the matching
+// resumeSearch(), return its best move so far. Requests are counted, so that
+// several can be pending at once. This is safe to call from any thread.
+void stopSearch() {
+    stopRequests.fetch_add(1, std::memory_order_relaxed);
+}
+
+void resumeSearch() {
+    stopRequests.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool isSearchStopped() {
+    return stopRequests.load(std::memory_order_relaxed) > 0;
+}
+
+void setLastGoodReply(bool enabled) {
+    lastGoodReply = enabled;
+}
+
+// Switches between playing out leaves one at a time with playRandomGame()
+// and in batches with the lockstep playout engine.
+void setLockstepPlayouts(bool enabled) {
+    Evaluator *rollouts = enabled ? (Evaluator *) &lockstepEvaluator
+                                  : (Evaluator *) &rolloutEvaluator;
+    mixedEvaluator.setFirst(rollouts);
+    if (evaluator != &mixedEvaluator)
+        evaluator = rollouts;
+}
+
+// Reseeds the search so that, for a fixed playout count, the same sequence of
+// commands always generates the same moves. From then on, the search cache is
+// not used.
+void setSearchSeed(uint64_t seed) {
+    searchRng.seed(seed);
+    seededSearch = true;
 }
@@ -1,10 +1,52 @@
 #ifndef __SEARCH_H__
 #define __SEARCH_H__
 
+#include <string>
+#include <vector>
+#include "board.h"
+#include "rng.h"
 #include "types.h"
 
 
+// Root statistics for one move, from the point of view of the player to move
+struct AnalysisMove {
+    Move m;
+    int visits;
+    float winrate;
+    float scoreLead;
+    std::vector<Move> pv;
+};
+
+struct AnalysisOptions {
+    int intervalMs;
+    // The number of most visited moves to report
+    int maxMoves;
+    void (*callback)(const std::vector<AnalysisMove> &moves);
+};
+
 Move generateMove(Player p, Move lastMove);
+Move searchUncached(Player p, Move lastMove, int maxPlayouts);
+void analyzePosition(Player p, Move lastMove, int maxPlayouts,
+    const AnalysisOptions &analysis);
 void resetSearchState();
+void saveSearchState();
+void restoreSearchState();
+void setSearchSeed(uint64_t seed);
+bool loadNetWeights(const std::string &filename);
+void setNetWeight(float weight);
+void setMercyThreshold(int threshold);
+void setTimeLimit(double seconds);
+bool saveSearchCache(const std::string &filename);
+bool loadSearchCache(const std::string &filename);
+void setPatternPlayouts(bool enabled);
+void setLockstepPlayouts(bool enabled);
+void setLastGoodReply(bool enabled);
+void stopSearch();
+void resumeSearch();
+bool isSearchStopped();
+
+Player playRandomGame(Player p, Board &b, Rng &rng);
+void scoreGame(Player p, Board &b, float &myScore, float &oppScore);
+void updateLastGoodReplies(Player winner);
 
 #endif
\ No newline at end of file
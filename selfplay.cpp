@@ -0,0 +1,480 @@
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "board.h"
+#include "patterns.h"
+#include "search.h"
+#include "sgf.h"
+
+using namespace std;
+
+
+/*
+ * A self-play match runner. Two engine command lines, A and B, play a series
+ * of games with colors alternating, on a pool of worker processes. Each
+ * worker starts its own pair of engines and talks GTP to them over pipes, so
+ * every game has its own engine state, and the two sides can differ in any
+ * setting their command lines take: playouts, playout policy, weights, or a
+ * different build altogether.
+ *
+ * Usage: go-selfplay [options]
+ *   --a CMD        the command line of engine A (default: ./go-engine)
+ *   --b CMD        the command line of engine B (default: ./go-engine)
+ *   --games N      the number of games (default 100)
+ *   --workers N    games played at once (default: one per core)
+ *   --size N       the board size (default 9)
+ *   --komi K       komi (default 7.5)
+ *   --seed S       engine seeds are S plus the game and side
+ *   --sgf DIR      write each game to DIR/game_<n>.sgf
+ *
+ * The runner keeps the board itself: an illegal move or a resignation loses
+ * the game, two passes in a row end it, and it is scored with the engine's
+ * own scoring, territory plus captures and komi. An engine that dies loses
+ * the game it was playing, and is restarted for the next one.
+ */
+
+extern int boardSize;
+extern int arraySize;
+extern Board game;
+extern float komi;
+extern uint64_t keyStack[4096];
+extern int keyStackSize;
+
+bool debugOutput = false;
+
+const string COLUMNS = "ABCDEFGHJKLMNOPQRSTUVWXYZ";
+
+
+//------------------------------------------------------------------------------
+//-------------------------------GTP Engines------------------------------------
+//------------------------------------------------------------------------------
+struct Engine {
+    pid_t pid;
+    FILE *in;
+    FILE *out;
+    // Cleared once the engine closes its output
+    bool alive;
+};
+
+// Runs command through the shell, with pipes to its stdin and stdout
+static bool startEngine(const string &command, Engine &e) {
+    // The pipes are closed on exec, so that engines don't hold each other's
+    // pipes open
+    int toEngine[2], fromEngine[2];
+    if (pipe2(toEngine, O_CLOEXEC) != 0)
+        return false;
+    if (pipe2(fromEngine, O_CLOEXEC) != 0) {
+        close(toEngine[0]);
+        close(toEngine[1]);
+        return false;
+    }
+
+    e.pid = fork();
+    if (e.pid == 0) {
+        // The runner ignores SIGPIPE, which exec would pass on
+        signal(SIGPIPE, SIG_DFL);
+        dup2(toEngine[0], STDIN_FILENO);
+        dup2(fromEngine[1], STDOUT_FILENO);
+        close(toEngine[0]);
+        close(toEngine[1]);
+        close(fromEngine[0]);
+        close(fromEngine[1]);
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *) NULL);
+        _exit(127);
+    }
+
+    close(toEngine[0]);
+    close(fromEngine[1]);
+    e.in = fdopen(toEngine[1], "w");
+    e.out = fdopen(fromEngine[0], "r");
+    e.alive = (e.pid > 0);
+    return e.alive;
+}
+
+// Sends a command and waits for the response. Returns false on an error
+// response or a dead engine, and sets response to the text after the status.
+static bool sendCommand(Engine &e, const string &command, string &response) {
+    fprintf(e.in, "%s\n", command.c_str());
+    fflush(e.in);
+
+    response = "";
+    char line[1024];
+    bool started = false;
+    bool ok = false;
+    while (fgets(line, sizeof(line), e.out) != NULL) {
+        string text(line);
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+            text.pop_back();
+        if (!started) {
+            if (text.empty())
+                continue;
+            started = true;
+            ok = (text[0] == '=');
+            response = (text.size() > 2) ? text.substr(2) : "";
+        }
+        // Responses end with an empty line
+        else if (text.empty())
+            return ok;
+    }
+    e.alive = false;
+    return false;
+}
+
+static void stopEngine(Engine &e) {
+    fprintf(e.in, "quit\n");
+    fclose(e.in);
+    fclose(e.out);
+    waitpid(e.pid, NULL, 0);
+}
+
+// Replaces an engine that has died. Returns false if it can't be restarted.
+static bool restartEngine(const string &command, Engine &e) {
+    stopEngine(e);
+    return startEngine(command, e);
+}
+
+
+//------------------------------------------------------------------------------
+//----------------------------------Games---------------------------------------
+//------------------------------------------------------------------------------
+struct GameResult {
+    Player winner;
+    // The winning margin in points, or 0 for a resignation or illegal move
+    float margin;
+    string reason;
+};
+
+static string moveToString(Move m) {
+    if (m == MOVE_PASS)
+        return "pass";
+    return COLUMNS[getX(m) - 1] + to_string(getY(m));
+}
+
+// Parses a vertex such as "D4" or "pass". Returns MOVE_NULL if it can't be
+// parsed or is off the board.
+static Move stringToMove(string text) {
+    for (unsigned int i = 0; i < text.size(); i++)
+        text[i] = toupper(text[i]);
+    if (text == "PASS")
+        return MOVE_PASS;
+    if (text.size() < 2)
+        return MOVE_NULL;
+    size_t column = COLUMNS.find(text[0]);
+    int y = atoi(text.c_str() + 1);
+    int x = (int) column + 1;
+    if (column == string::npos || x > boardSize || y < 1 || y > boardSize)
+        return MOVE_NULL;
+    return coordToMove(x, y);
+}
+
+// Returns true if p may play m on the runner's board: the point is empty, the
+// move is not suicide, and it does not repeat an earlier position
+static bool isLegal(Player p, Move m) {
+    if (m == MOVE_PASS)
+        return true;
+    if (game.getStone(getX(m), getY(m)) != EMPTY || !game.isMoveValid(p, m))
+        return false;
+    uint64_t key = game.getZobristKeyAfter(p, m);
+    for (int i = 0; i < keyStackSize; i++)
+        if (keyStack[i] == key)
+            return false;
+    return true;
+}
+
+static GameResult playGame(Engine &black, Engine &white, int maxMoves,
+        uint64_t seed, SgfGame &record) {
+    string response;
+    Engine *engines[2] = {&black, &white};
+    for (int i = 0; i < 2; i++) {
+        sendCommand(*engines[i], "boardsize " + to_string(boardSize), response);
+        sendCommand(*engines[i], "komi " + to_string(komi), response);
+        sendCommand(*engines[i], "clear_board", response);
+        sendCommand(*engines[i], "seed " + to_string(seed + i), response);
+    }
+
+    game.reset();
+    keyStackSize = 0;
+    record.boardSize = boardSize;
+    record.komi = komi;
+    record.colors.clear();
+    record.moves.clear();
+
+    Player p = BLACK;
+    int passes = 0;
+    GameResult result;
+    while (passes < 2 && (int) record.moves.size() < maxMoves
+        && keyStackSize < 4096) {
+        Engine &toMove = (p == BLACK) ? black : white;
+        Engine &opponent = (p == BLACK) ? white : black;
+        string color = (p == BLACK) ? "b" : "w";
+
+        if (!sendCommand(toMove, "genmove " + color, response)) {
+            result.winner = otherPlayer(p);
+            result.margin = 0;
+            result.reason = "error";
+            return result;
+        }
+        if (response == "resign") {
+            result.winner = otherPlayer(p);
+            result.margin = 0;
+            result.reason = "resign";
+            return result;
+        }
+        Move m = stringToMove(response);
+        if (m == MOVE_NULL || !isLegal(p, m)) {
+            result.winner = otherPlayer(p);
+            result.margin = 0;
+            result.reason = "illegal";
+            return result;
+        }
+
+        record.colors.push_back(p);
+        record.moves.push_back(m);
+        if (m == MOVE_PASS)
+            passes++;
+        else {
+            passes = 0;
+            keyStack[keyStackSize++] = game.getZobristKey();
+        }
+        // A pass also clears the runner's ko, as it does the engines'
+        game.doMove(p, m);
+        if (!sendCommand(opponent, "play " + color + " " + moveToString(m),
+                response)) {
+            result.winner = p;
+            result.margin = 0;
+            result.reason = "error";
+            return result;
+        }
+        p = otherPlayer(p);
+    }
+
+    float blackScore, whiteScore;
+    game.updateSettled();
+    scoreGame(BLACK, game, blackScore, whiteScore);
+    result.winner = (blackScore > whiteScore) ? BLACK
+                  : (whiteScore > blackScore) ? WHITE : EMPTY;
+    result.margin = fabs(blackScore - whiteScore);
+    result.reason = "score";
+    return result;
+}
+
+static string resultString(const GameResult &result) {
+    if (result.winner == EMPTY)
+        return "0";
+    ostringstream text;
+    text << ((result.winner == BLACK) ? "B+" : "W+");
+    if (result.reason == "score")
+        text << result.margin;
+    else if (result.reason == "resign")
+        text << "R";
+    else
+        text << "F";
+    return text.str();
+}
+
+
+//------------------------------------------------------------------------------
+//----------------------------------Workers-------------------------------------
+//------------------------------------------------------------------------------
+struct MatchOptions {
+    string commandA;
+    string commandB;
+    int games;
+    int workers;
+    uint64_t seed;
+    string sgfDirectory;
+};
+
+// Plays every game whose number is w modulo the worker count, writing a line
+// per game to out: the game number, whether A had black, and the result
+static void runWorker(const MatchOptions &options, int w, int out) {
+    Engine a, b;
+    if (!startEngine(options.commandA, a)
+     || !startEngine(options.commandB, b)) {
+        cerr << "worker " << w << ": could not start the engines" << endl;
+        _exit(1);
+    }
+
+    int maxMoves = 3 * boardSize * boardSize;
+    SgfGame record;
+    for (int g = w; g < options.games; g += options.workers) {
+        if ((!a.alive && !restartEngine(options.commandA, a))
+         || (!b.alive && !restartEngine(options.commandB, b))) {
+            cerr << "worker " << w << ": could not restart an engine, games "
+                 << "from " << g << " on are lost" << endl;
+            break;
+        }
+
+        bool aIsBlack = (g % 2 == 0);
+        Engine &black = aIsBlack ? a : b;
+        Engine &white = aIsBlack ? b : a;
+        GameResult result = playGame(black, white, maxMoves,
+            options.seed + 2 * g, record);
+
+        if (!options.sgfDirectory.empty()) {
+            ofstream file(options.sgfDirectory + "/game_" + to_string(g)
+                + ".sgf");
+            file << writeSgf(record,
+                aIsBlack ? options.commandA : options.commandB,
+                aIsBlack ? options.commandB : options.commandA,
+                resultString(result));
+        }
+
+        string line = to_string(g) + "\t" + (aIsBlack ? "A" : "B")
+            + "\t" + resultString(result) + "\t" + result.reason
+            + "\t" + to_string(record.moves.size()) + "\n";
+        if (write(out, line.data(), line.size()) < 0)
+            break;
+
+        if (!a.alive || !b.alive) {
+            cerr << "worker " << w << ": engine " << (a.alive ? "B" : "A")
+                 << " died in game " << g << endl;
+        }
+    }
+
+    stopEngine(a);
+    stopEngine(b);
+}
+
+int main(int argc, char **argv) {
+    initZobristTable();
+    initPatterns();
+
+    MatchOptions options;
+    options.commandA = "./go-engine";
+    options.commandB = "./go-engine";
+    options.games = 100;
+    options.workers = thread::hardware_concurrency();
+    options.seed = 1;
+    boardSize = 9;
+    komi = 7.5;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = string(argv[i]);
+        if (arg == "--a" && i+1 < argc)
+            options.commandA = string(argv[++i]);
+        else if (arg == "--b" && i+1 < argc)
+            options.commandB = string(argv[++i]);
+        else if (arg == "--games" && i+1 < argc)
+            options.games = stoi(string(argv[++i]));
+        else if (arg == "--workers" && i+1 < argc)
+            options.workers = stoi(string(argv[++i]));
+        else if (arg == "--size" && i+1 < argc)
+            boardSize = stoi(string(argv[++i]));
+        else if (arg == "--komi" && i+1 < argc)
+            komi = stof(string(argv[++i]));
+        else if (arg == "--seed" && i+1 < argc)
+            options.seed = stoull(string(argv[++i]));
+        else if (arg == "--sgf" && i+1 < argc)
+            options.sgfDirectory = string(argv[++i]);
+        else {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (boardSize < 3 || boardSize > 21) {
+        cerr << "Unacceptable board size" << endl;
+        return 1;
+    }
+    arraySize = boardSize + 2;
+    if (options.workers < 1)
+        options.workers = 1;
+    if (options.workers > options.games)
+        options.workers = max(1, options.games);
+
+    // Writing to a dead engine should fail rather than kill the worker
+    signal(SIGPIPE, SIG_IGN);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        cerr << "Could not create pipe" << endl;
+        return 1;
+    }
+
+    auto startTime = chrono::steady_clock::now();
+    vector<pid_t> children;
+    for (int w = 0; w < options.workers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            runWorker(options, w, fds[1]);
+            close(fds[1]);
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+    close(fds[1]);
+
+    // Results arrive a line at a time, in the order the games finish
+    int played = 0, winsA = 0, draws = 0;
+    int blackWins = 0, winsAsBlack = 0, winsAsWhite = 0;
+    FILE *results = fdopen(fds[0], "r");
+    char line[1024];
+    while (fgets(line, sizeof(line), results) != NULL) {
+        int g, moves;
+        char aColor, result[64], reason[64];
+        if (sscanf(line, "%d\t%c\t%63s\t%63s\t%d", &g, &aColor, result, reason,
+                &moves) != 5)
+            continue;
+        bool aIsBlack = (aColor == 'A');
+        played++;
+        if (result[0] == '0') {
+            draws++;
+            cout << "game " << g << ": draw after " << moves << " moves" << endl;
+            continue;
+        }
+        bool blackWon = (result[0] == 'B');
+        bool aWon = (blackWon == aIsBlack);
+        blackWins += blackWon;
+        if (aWon) {
+            winsA++;
+            if (aIsBlack)
+                winsAsBlack++;
+            else
+                winsAsWhite++;
+        }
+        cout << "game " << g << ": " << (aWon ? "A" : "B") << " wins as "
+             << (blackWon ? "black" : "white") << ", " << result << " ("
+             << reason << ") after " << moves << " moves" << endl;
+    }
+    fclose(results);
+    for (unsigned int i = 0; i < children.size(); i++)
+        waitpid(children[i], NULL, 0);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    if (played == 0) {
+        cerr << "No games were played" << endl;
+        return 1;
+    }
+    if (played < options.games) {
+        cerr << options.games - played << " of " << options.games
+             << " games were lost to engine failures" << endl;
+    }
+
+    // Draws count as half a win. The interval is the normal approximation to
+    // the binomial at 95%.
+    double score = (winsA + 0.5 * draws) / played;
+    double interval = 1.96 * sqrt(score * (1 - score) / played);
+    cout << endl << "A: " << options.commandA << endl
+         << "B: " << options.commandB << endl
+         << played << " games: A " << winsA << " (" << winsAsBlack
+         << " as black, " << winsAsWhite << " as white), B "
+         << played - winsA - draws << ", draws " << draws << endl
+         << "A scores " << 100 * score << "% +- " << 100 * interval
+         << "% (95% confidence)" << endl
+         << "Black wins " << blackWins << ", white wins "
+         << played - blackWins - draws << endl
+         << elapsed.count() << " sec, "
+         << 3600 * played / elapsed.count() << " games/hour" << endl;
+    return 0;
+}
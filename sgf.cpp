@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sstream>
+#include "sgf.h"
+
+
+// Property names packed into an integer, one character per byte, so that
+// names can be compared without copying them out of the text
+static inline uint32_t propertyCode(const char *name) {
+    uint32_t code = 0;
+    for (; *name != '\0'; name++)
+        code = (code << 8) | *name;
+    return code;
+}
+
+static const uint32_t PROPERTY_SZ = propertyCode("SZ");
+static const uint32_t PROPERTY_KM = propertyCode("KM");
+static const uint32_t PROPERTY_AB = propertyCode("AB");
+static const uint32_t PROPERTY_AW = propertyCode("AW");
+static const uint32_t PROPERTY_RE = propertyCode("RE");
+static const uint32_t PROPERTY_B = propertyCode("B");
+static const uint32_t PROPERTY_W = propertyCode("W");
+
+// Converts SGF point coordinates, with "aa" in the top left corner, to a move.
+// An empty value, or "tt" on boards up to 19x19, is a pass.
+static Move sgfToMove(const char *value, int length, int size) {
+    if (length < 2)
+        return MOVE_PASS;
+    int x = value[0] - 'a' + 1;
+    int y = size - (value[1] - 'a');
+    if (x < 1 || x > size || y < 1 || y > size)
+        return MOVE_PASS;
+    return coordToMove(x, y);
+}
+
+// The inverse of sgfToMove()
+static std::string moveToSgf(Move m, int size) {
+    if (m == MOVE_PASS)
+        return "";
+    std::string point(2, 'a');
+    point[0] += getX(m) - 1;
+    point[1] += size - getY(m);
+    return point;
+}
+
+// Escapes the characters that would end an SGF value early
+static std::string escapeSgf(const std::string &text) {
+    std::string escaped;
+    for (unsigned int i = 0; i < text.size(); i++) {
+        if (text[i] == ']' || text[i] == '\\')
+            escaped += '\\';
+        escaped += text[i];
+    }
+    return escaped;
+}
+
+// Parses a decimal number such as "6.5" or "-3" in place. Values are not
+// null terminated inside the mapped file, so the standard library can't be used.
+static double parseNumber(const char *value, int length) {
+    int i = 0;
+    while (i < length && value[i] == ' ')
+        i++;
+    double sign = 1.0;
+    if (i < length && (value[i] == '-' || value[i] == '+')) {
+        if (value[i] == '-')
+            sign = -1.0;
+        i++;
+    }
+    double number = 0.0;
+    for (; i < length && value[i] >= '0' && value[i] <= '9'; i++)
+        number = number * 10 + (value[i] - '0');
+    if (i < length && value[i] == '.') {
+        double scale = 0.1;
+        for (i++; i < length && value[i] >= '0' && value[i] <= '9'; i++) {
+            number += scale * (value[i] - '0');
+            scale *= 0.1;
+        }
+    }
+    return sign * number;
+}
+
+// Parses the main line of an SGF record. Returns false if the text does not
+// start with a game tree.
+bool parseSgf(const char *text, int length, SgfGame &game) {
+    game.boardSize = 19;
+    game.komi = 0.0;
+    game.blackSetup.clear();
+    game.whiteSetup.clear();
+    game.colors.clear();
+    game.moves.clear();
+    game.winner = EMPTY;
+
+    int i = 0;
+    while (i < length && text[i] != '(')
+        i++;
+    if (i == length)
+        return false;
+    i++;
+
+    // Every move is in a node of its own, so the number of nodes bounds the
+    // number of moves, and the move lists are allocated only once
+    int nodes = 0;
+    for (int j = i; j < length; j++)
+        nodes += (text[j] == ';');
+    game.colors.reserve(nodes);
+    game.moves.reserve(nodes);
+
+    // The main line is the first variation at every branch, so it ends at the
+    // first closing parenthesis
+    uint32_t property = 0;
+    bool inName = false;
+    while (i < length && text[i] != ')') {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') {
+            if (!inName)
+                property = 0;
+            inName = true;
+            property = (property << 8) | c;
+            i++;
+        }
+        else if (c == '[') {
+            inName = false;
+            int start = ++i;
+            while (i < length && text[i] != ']') {
+                // Escaped characters, including \], are part of the value
+                if (text[i] == '\\')
+                    i++;
+                i++;
+            }
+            if (i >= length)
+                break;
+            const char *value = text + start;
+            int valueLength = i - start;
+            i++;
+
+            if (property == PROPERTY_SZ)
+                game.boardSize = (int) parseNumber(value, valueLength);
+            else if (property == PROPERTY_KM)
+                game.komi = (float) parseNumber(value, valueLength);
+            else if (property == PROPERTY_RE && valueLength > 1
+                  && value[1] == '+')
+                game.winner = (value[0] == 'B') ? BLACK
+                            : (value[0] == 'W') ? WHITE : EMPTY;
+            else if (property == PROPERTY_AB)
+                game.blackSetup.push_back(sgfToMove(value, valueLength,
+                    game.boardSize));
+            else if (property == PROPERTY_AW)
+                game.whiteSetup.push_back(sgfToMove(value, valueLength,
+                    game.boardSize));
+            else if (property == PROPERTY_B || property == PROPERTY_W) {
+                game.colors.push_back((property == PROPERTY_B) ? BLACK : WHITE);
+                game.moves.push_back(sgfToMove(value, valueLength,
+                    game.boardSize));
+            }
+            // Further values of the same property, as in AB[aa][bb], keep the
+            // property name
+        }
+        else {
+            // Node and variation markers, whitespace, and lowercase letters
+            // of old style property names
+            if (c == ';' || c == '(')
+                inName = false;
+            i++;
+        }
+    }
+
+    return true;
+}
+
+// Maps the file into memory and parses it in place.
+bool loadSgf(const std::string &filename, SgfGame &game) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+    bool parsed = parseSgf((const char *) data, info.st_size, game);
+    munmap(data, info.st_size);
+    return parsed;
+}
+
+// Plays a move from a record, pushing the key of the position it leaves onto
+// the superko history. Returns false if the point is taken.
+bool playSgfMove(Board &b, Player p, Move m, uint64_t *keys, int &keyCount) {
+    if (m == MOVE_PASS)
+        return true;
+    if (b.getStone(getX(m), getY(m)) != EMPTY)
+        return false;
+    keys[keyCount++] = b.getZobristKey();
+    b.doMove(p, m);
+    return true;
+}
+
+// Places the setup stones of a record on an empty board, then plays its first
+// moveCount moves. Stops early at a move on a taken point, or when the history
+// is full. Returns the number of moves played.
+int replaySgf(const SgfGame &game, int moveCount, Board &b, uint64_t *keys,
+        int &keyCount, int maxKeys) {
+    for (unsigned int i = 0; i < game.blackSetup.size(); i++) {
+        Move m = game.blackSetup[i];
+        if (m != MOVE_PASS && b.getStone(getX(m), getY(m)) == EMPTY)
+            b.doMove(BLACK, m);
+    }
+    for (unsigned int i = 0; i < game.whiteSetup.size(); i++) {
+        Move m = game.whiteSetup[i];
+        if (m != MOVE_PASS && b.getStone(getX(m), getY(m)) == EMPTY)
+            b.doMove(WHITE, m);
+    }
+
+    if (moveCount < 0 || moveCount > (int) game.moves.size())
+        moveCount = game.moves.size();
+    int played = 0;
+    while (played < moveCount && keyCount < maxKeys) {
+        if (!playSgfMove(b, game.colors[played], game.moves[played], keys,
+                keyCount))
+            break;
+        played++;
+    }
+    return played;
+}
+
+// Formats a game as an SGF record with the given player names and result, in
+// SGF's RE[] notation such as "B+3.5"
+std::string writeSgf(const SgfGame &game, const std::string &black,
+        const std::string &white, const std::string &result) {
+    std::ostringstream sgf;
+    sgf << "(;GM[1]FF[4]SZ[" << game.boardSize << "]KM[" << game.komi << "]"
+        << "PB[" << escapeSgf(black) << "]PW[" << escapeSgf(white) << "]"
+        << "RE[" << escapeSgf(result) << "]";
+    if (!game.blackSetup.empty()) {
+        sgf << "AB";
+        for (unsigned int i = 0; i < game.blackSetup.size(); i++)
+            sgf << "[" << moveToSgf(game.blackSetup[i], game.boardSize) << "]";
+    }
+    if (!game.whiteSetup.empty()) {
+        sgf << "AW";
+        for (unsigned int i = 0; i < game.whiteSetup.size(); i++)
+            sgf << "[" << moveToSgf(game.whiteSetup[i], game.boardSize) << "]";
+    }
+    for (unsigned int i = 0; i < game.moves.size(); i++) {
+        sgf << ((i % 10 == 0) ? "\n" : "");
+        sgf << ";" << ((game.colors[i] == BLACK) ? "B" : "W")
+            << "[" << moveToSgf(game.moves[i], game.boardSize) << "]";
+    }
+    sgf << ")\n";
+    return sgf.str();
+}
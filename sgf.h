@@ -0,0 +1,36 @@
+#ifndef __SGF_H__
+#define __SGF_H__
+
+#include <string>
+#include <vector>
+#include "board.h"
+#include "types.h"
+
+/*
+ * The main line of an SGF game record: the size, komi, setup stones and
+ * moves. Variations are skipped, and unknown properties are ignored. Moves
+ * are in the engine's coordinates, with passes as MOVE_PASS.
+ *
+ * Files are memory mapped and parsed in place: the only allocations are the
+ * move lists, which are sized once from the number of nodes.
+ */
+struct SgfGame {
+    int boardSize;
+    float komi;
+    std::vector<Move> blackSetup;
+    std::vector<Move> whiteSetup;
+    std::vector<Player> colors;
+    std::vector<Move> moves;
+    // From the RE property: EMPTY for a draw or an unknown result
+    Player winner;
+};
+
+bool parseSgf(const char *text, int length, SgfGame &game);
+bool loadSgf(const std::string &filename, SgfGame &game);
+bool playSgfMove(Board &b, Player p, Move m, uint64_t *keys, int &keyCount);
+int replaySgf(const SgfGame &game, int moveCount, Board &b, uint64_t *keys,
+    int &keyCount, int maxKeys);
+std::string writeSgf(const SgfGame &game, const std::string &black,
+    const std::string &white, const std::string &result);
+
+#endif
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "rng.h"
+#include "search.h"
+#include "solver.h"
+
+
+extern int boardSize;
+
+const uint32_t PN_INF = 1 << 30;
+// Set in an entry's data for a proof that relied on a repetition or the depth
+// limit. Proof numbers never exceed PN_INF, so the bit is otherwise unused.
+const uint64_t PATH_DEPENDENT = 1ULL << 31;
+const int MAX_CHILDREN = SOLVER_MAX_SIZE * SOLVER_MAX_SIZE + 1;
+const int MAX_DEPTH = 3 * SOLVER_MAX_SIZE * SOLVER_MAX_SIZE;
+const int TABLE_BITS = 22;
+
+// Mixed into the Zobrist key for the parts of the state that stones do not
+// cover. The capture difference is part of the score, so positions that
+// only differ in it are different nodes.
+const uint64_t WHITE_TO_MOVE_KEY = 0x9E3779B97F4A7C15ULL;
+const uint64_t PASSED_KEY = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t KO_KEY = 0x165667B19E3779F9ULL;
+const uint64_t CAPTURES_KEY = 0x27D4EB2F165667C5ULL;
+
+const int DX[4] = {1, -1, 0, 0};
+const int DY[4] = {0, 0, 1, -1};
+
+
+//------------------------------------------------------------------------------
+//----------------------------Transposition Table-------------------------------
+//------------------------------------------------------------------------------
+/*
+ * Each entry holds the proof and disproof numbers of a position for its
+ * player to move, packed into one word with the path dependent flag, and a
+ * check word that is the key xored with the data. A torn write from another
+ * thread leaves a check that does not match, which reads as a miss, so no
+ * locks are needed.
+ */
+struct TableEntry {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+};
+
+struct SolverShared {
+    TableEntry *table;
+    Player root;
+    int maxDepth;
+    uint64_t maxNodes;
+    double maxSeconds;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<uint64_t> nodes;
+    std::atomic<bool> stop;
+};
+
+static void probe(SolverShared &s, uint64_t key, uint32_t &phi, uint32_t &delta,
+    bool &pathDependent) {
+    TableEntry &e = s.table[key >> (64 - TABLE_BITS)];
+    uint64_t data = e.data.load(std::memory_order_relaxed);
+    uint64_t check = e.check.load(std::memory_order_relaxed);
+    pathDependent = false;
+    if ((check ^ data) != key) {
+        phi = 1;
+        delta = 1;
+        return;
+    }
+    pathDependent = (data & PATH_DEPENDENT) != 0;
+    phi = (uint32_t) (data >> 32);
+    delta = (uint32_t) (data & ~PATH_DEPENDENT);
+}
+
+// Looks up a position reached by some other path. A proof that relied on a
+// repetition or the depth limit on the path it was found from does not hold
+// here, so it reads as a new node.
+static void lookup(SolverShared &s, uint64_t key, uint32_t &phi,
+    uint32_t &delta) {
+    bool pathDependent;
+    probe(s, key, phi, delta, pathDependent);
+    if (pathDependent) {
+        phi = 1;
+        delta = 1;
+    }
+}
+
+// Proven results are final, so they are never replaced by unproven numbers
+// for the same position from a thread that has not seen the proof yet. Path
+// dependent proofs are not final, and may be replaced.
+static void store(SolverShared &s, uint64_t key, uint32_t phi, uint32_t delta,
+    bool pathDependent) {
+    TableEntry &e = s.table[key >> (64 - TABLE_BITS)];
+    uint64_t old = e.data.load(std::memory_order_relaxed);
+    bool proven = !(old & PATH_DEPENDENT)
+        && ((old >> 32) == 0 || (uint32_t) old == 0);
+    if (proven && (e.check.load(std::memory_order_relaxed) ^ old) == key)
+        return;
+    uint64_t data = ((uint64_t) phi << 32) | delta;
+    if (pathDependent)
+        data |= PATH_DEPENDENT;
+    e.data.store(data, std::memory_order_relaxed);
+    e.check.store(key ^ data, std::memory_order_relaxed);
+}
+
+inline uint64_t positionKey(Board &b, Player p, int passes) {
+    uint64_t key = b.getZobristKey();
+    if (p == WHITE)
+        key ^= WHITE_TO_MOVE_KEY;
+    if (passes)
+        key ^= PASSED_KEY;
+    key ^= (uint64_t) (b.getCaptureDifference(BLACK) + 1024) * CAPTURES_KEY;
+    return key ^ (b.getKoPoint(p) * KO_KEY);
+}
+
+// Returns true if any of p's chains next to m is in atari
+static bool touchesAtari(Board &b, Player p, Move m) {
+    for (int d = 0; d < 4; d++) {
+        int x = getX(m) + DX[d];
+        int y = getY(m) + DY[d];
+        if (b.getStone(x, y) == p && b.isInAtari(coordToMove(x, y)))
+            return true;
+    }
+    return false;
+}
+
+// Moves into own eyes are skipped, unless they save a chain in atari
+static bool isCandidate(Board &b, Player p, Move m) {
+    if (m == MOVE_PASS)
+        return true;
+    if (!b.isMoveValid(p, m))
+        return false;
+    return !b.isEye(p, m) || touchesAtari(b, p, m);
+}
+
+
+//------------------------------------------------------------------------------
+//--------------------------Proof-Number Search---------------------------------
+//------------------------------------------------------------------------------
+/*
+ * The search is done in negamax form: phi is the proof number of a win for
+ * the player to move, and delta its disproof number. A node's phi is the
+ * smallest delta of its children and its delta is the sum of their phis.
+ * Repeated positions on the current path, and games longer than the depth
+ * limit, are counted as losses for the root player. Those outcomes depend on
+ * the path taken, so proofs that rely on them are marked path dependent, and
+ * are not reused when the position is reached by another path.
+ */
+struct SolverChild {
+    Move move;
+    uint64_t key;
+    uint32_t phi;
+    uint32_t delta;
+    bool pathDependent;
+};
+
+struct DfpnSearch {
+    SolverShared *shared;
+    Rng rng;
+    // Whether ties between children are broken randomly, so that the threads
+    // do not all follow the same path
+    bool randomTies;
+    uint64_t path[MAX_DEPTH + 1];
+    int sinceCheck;
+
+    bool outOfBudget();
+    void setOutcome(bool rootWins, Player p, uint32_t &phi, uint32_t &delta);
+    void mid(Board &b, Player p, int passes, uint64_t key, int depth,
+        uint32_t thPhi, uint32_t thDelta, uint32_t &phi, uint32_t &delta,
+        bool &pathDependent);
+};
+
+bool DfpnSearch::outOfBudget() {
+    if (shared->stop.load(std::memory_order_relaxed))
+        return true;
+    if (isSearchStopped())
+        shared->stop = true;
+    if (shared->nodes.fetch_add(1, std::memory_order_relaxed) >= shared->maxNodes)
+        shared->stop = true;
+    else if (++sinceCheck >= 1024) {
+        sinceCheck = 0;
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - shared->start;
+        if (elapsed.count() >= shared->maxSeconds)
+            shared->stop = true;
+    }
+    return shared->stop.load(std::memory_order_relaxed);
+}
+
+void DfpnSearch::setOutcome(bool rootWins, Player p, uint32_t &phi,
+    uint32_t &delta) {
+    bool won = (p == shared->root) == rootWins;
+    phi = won ? 0 : PN_INF;
+    delta = won ? PN_INF : 0;
+}
+
+void DfpnSearch::mid(Board &b, Player p, int passes, uint64_t key, int depth,
+    uint32_t thPhi, uint32_t thDelta, uint32_t &phi, uint32_t &delta,
+    bool &pathDependent) {
+    pathDependent = false;
+    if (outOfBudget()) {
+        lookup(*shared, key, phi, delta);
+        return;
+    }
+    for (int i = 0; i < depth; i++) {
+        if (path[i] == key) {
+            setOutcome(false, p, phi, delta);
+            pathDependent = true;
+            return;
+        }
+    }
+    if (depth >= shared->maxDepth) {
+        setOutcome(false, p, phi, delta);
+        pathDependent = true;
+        return;
+    }
+    path[depth] = key;
+
+    SolverChild children[MAX_CHILDREN];
+    int numChildren = 0;
+    Player opp = otherPlayer(p);
+    MoveList moves = b.getLegalMoves(p);
+    for (unsigned int i = 0; i < moves.size(); i++) {
+        Move m = moves.get(i);
+        if (!isCandidate(b, p, m))
+            continue;
+
+        SolverChild &c = children[numChildren++];
+        c.move = m;
+        // Only captures can leave a ko point behind
+        if (touchesAtari(b, opp, m)) {
+            Board next(b);
+            next.doMove(p, m);
+            c.key = positionKey(next, opp, 0);
+        }
+        else {
+            c.key = b.getZobristKeyAfter(p, m);
+            if (opp == WHITE)
+                c.key ^= WHITE_TO_MOVE_KEY;
+            c.key ^= (uint64_t) (b.getCaptureDifference(BLACK) + 1024)
+                * CAPTURES_KEY;
+        }
+        lookup(*shared, c.key, c.phi, c.delta);
+        c.pathDependent = false;
+    }
+
+    SolverChild &pass = children[numChildren++];
+    pass.move = MOVE_PASS;
+    pass.pathDependent = false;
+    if (passes) {
+        // A second pass ends the game
+        float myScore, oppScore;
+        scoreGame(shared->root, b, myScore, oppScore);
+        setOutcome(myScore > oppScore, opp, pass.phi, pass.delta);
+        pass.key = 0;
+    }
+    else {
+        Board next(b);
+        next.doMove(p, MOVE_PASS);
+        pass.key = positionKey(next, opp, 1);
+        lookup(*shared, pass.key, pass.phi, pass.delta);
+    }
+
+    while (true) {
+        uint64_t phiSum = 0;
+        uint32_t minDelta = PN_INF;
+        uint32_t secondDelta = PN_INF;
+        int best = -1;
+        for (int i = 0; i < numChildren; i++) {
+            SolverChild &c = children[i];
+            phiSum += c.phi;
+            bool better = c.delta < minDelta || best == -1
+                || (randomTies && c.delta == minDelta && rng.bounded(2));
+            if (better) {
+                if (best != -1)
+                    secondDelta = std::min(secondDelta, minDelta);
+                minDelta = c.delta;
+                best = i;
+            }
+            else
+                secondDelta = std::min(secondDelta, c.delta);
+        }
+        phi = minDelta;
+        delta = (uint32_t) std::min(phiSum, (uint64_t) PN_INF);
+
+        if (phi >= thPhi || delta >= thDelta || shared->stop)
+            break;
+
+        SolverChild &c = children[best];
+        uint32_t childThPhi = (thDelta >= PN_INF) ? PN_INF
+            : thDelta + c.phi - delta;
+        uint32_t childThDelta = std::min((uint64_t) thPhi,
+            (uint64_t) secondDelta + secondDelta / 4 + 1);
+
+        Board next(b);
+        next.doMove(p, c.move);
+        mid(next, opp, (c.move == MOVE_PASS) ? 1 : 0, c.key, depth + 1,
+            childThPhi, childThDelta, c.phi, c.delta, c.pathDependent);
+    }
+
+    // A win is path dependent if every winning child is, and a loss if any
+    // child is
+    if (phi == 0) {
+        pathDependent = true;
+        for (int i = 0; i < numChildren; i++)
+            if (children[i].delta == 0 && !children[i].pathDependent)
+                pathDependent = false;
+    }
+    else if (delta == 0) {
+        for (int i = 0; i < numChildren; i++)
+            if (children[i].pathDependent)
+                pathDependent = true;
+    }
+    store(*shared, key, phi, delta, pathDependent);
+}
+
+
+//------------------------------------------------------------------------------
+//---------------------------------Solver Entry---------------------------------
+//------------------------------------------------------------------------------
+// Solves the position for player p to move, with the given budget. With
+// several threads, each runs its own df-pn from the root over the shared
+// transposition table.
+SolveResult solveGame(Board &b, Player p, uint64_t maxNodes, double maxSeconds,
+    int threads) {
+    SolverShared shared;
+    shared.table = new TableEntry[1 << TABLE_BITS];
+    for (int i = 0; i < (1 << TABLE_BITS); i++) {
+        shared.table[i].check.store(0, std::memory_order_relaxed);
+        shared.table[i].data.store(0, std::memory_order_relaxed);
+    }
+    shared.root = p;
+    shared.maxDepth = std::min(MAX_DEPTH, 3 * boardSize * boardSize);
+    shared.maxNodes = maxNodes;
+    shared.maxSeconds = maxSeconds;
+    shared.start = std::chrono::steady_clock::now();
+    shared.nodes = 0;
+    shared.stop = false;
+
+    uint64_t rootKey = positionKey(b, p, 0);
+    if (threads < 1)
+        threads = 1;
+    DfpnSearch *searches = new DfpnSearch[threads];
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        DfpnSearch &s = searches[t];
+        s.shared = &shared;
+        s.rng.seed(t);
+        s.randomTies = (t > 0);
+        s.sinceCheck = 0;
+        workers.push_back(std::thread([&b, &s, &shared, p, rootKey]() {
+            Board root(b);
+            uint32_t phi, delta;
+            bool pathDependent;
+            s.mid(root, p, 0, rootKey, 0, PN_INF, PN_INF, phi, delta,
+                pathDependent);
+            // The first thread to finish the proof stops the others
+            shared.stop = true;
+        }));
+    }
+    for (int t = 0; t < threads; t++)
+        workers[t].join();
+
+    // A result that relied on a repetition or the depth limit is not proven
+    SolveResult result;
+    uint32_t phi, delta;
+    bool pathDependent;
+    probe(shared, rootKey, phi, delta, pathDependent);
+    result.result = pathDependent ? SOLVE_UNKNOWN
+                  : (phi == 0) ? SOLVE_WIN
+                  : (delta == 0) ? SOLVE_LOSS : SOLVE_UNKNOWN;
+    result.nodes = shared.nodes;
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - shared.start;
+    result.seconds = elapsed.count();
+
+    // A proven win has a child that the opponent loses. Otherwise, the child
+    // with the smallest disproof number is the best try, and the one with the
+    // largest proof number holds out longest.
+    result.bestMove = MOVE_PASS;
+    uint32_t bestScore = PN_INF + 1;
+    MoveList moves = b.getLegalMoves(p);
+    moves.add(MOVE_PASS);
+    for (unsigned int i = 0; i < moves.size(); i++) {
+        Move m = moves.get(i);
+        if (!isCandidate(b, p, m))
+            continue;
+        Board next(b);
+        next.doMove(p, m);
+        uint32_t childPhi, childDelta;
+        lookup(shared, positionKey(next, otherPlayer(p), m == MOVE_PASS),
+            childPhi, childDelta);
+        uint32_t score = (result.result == SOLVE_LOSS) ? PN_INF - childPhi
+                                                       : childDelta;
+        if (score < bestScore) {
+            bestScore = score;
+            result.bestMove = m;
+        }
+    }
+
+    delete[] searches;
+    delete[] shared.table;
+    return result;
+}
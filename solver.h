@@ -0,0 +1,36 @@
+#ifndef __SOLVER_H__
+#define __SOLVER_H__
+
+#include "board.h"
+#include "types.h"
+
+/*
+ * An exact solver for small boards, using depth-first proof-number search
+ * (df-pn). The question solved is whether the player to move wins under the
+ * engine's own rules: captures plus territory with komi, the game ending
+ * after two passes. A drawn game counts as a loss. Results that rely on a
+ * repeated position or on the game length limit are not proofs, and are
+ * reported as unknown.
+ *
+ * Nodes are shared between threads through a lock-free transposition table,
+ * and the search stops when the node or time budget runs out.
+ */
+const int SOLVER_MAX_SIZE = 7;
+
+const int SOLVE_UNKNOWN = 0;
+const int SOLVE_WIN = 1;
+const int SOLVE_LOSS = 2;
+
+struct SolveResult {
+    int result;
+    // The winning move if proven, the most promising move if unknown, and
+    // the move that holds out longest if lost
+    Move bestMove;
+    uint64_t nodes;
+    double seconds;
+};
+
+SolveResult solveGame(Board &b, Player p, uint64_t maxNodes, double maxSeconds,
+    int threads);
+
+#endif
@@ -0,0 +1,55 @@
+#include <iomanip>
+#include "stats.h"
+
+bool statsEnabled = false;
+SearchStats searchStats;
+
+const char *const PHASE_NAMES[NUM_STATS_PHASES] = {
+    "search", "selection", "expansion", "playout", "scoring", "backpropagation"
+};
+const char *const COUNT_NAMES[NUM_STATS_COUNTS] = {
+    "board copies", "chain lookups", "chain allocations", "node allocations"
+};
+
+
+void setStatsEnabled(bool enabled) {
+    statsEnabled = enabled;
+}
+
+void resetStats() {
+    for (int i = 0; i < NUM_STATS_PHASES; i++) {
+        searchStats.cycles[i].store(0, std::memory_order_relaxed);
+        searchStats.calls[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < NUM_STATS_COUNTS; i++)
+        searchStats.counts[i].store(0, std::memory_order_relaxed);
+}
+
+// Prints each phase's total cycles, calls, cycles per call and share of the
+// whole search, then the event counts. Phases nest inside the search, and
+// scoring may happen inside a playout, so the shares need not add up.
+void printStats(std::ostream &out) {
+    uint64_t total = searchStats.cycles[PHASE_SEARCH].load(
+        std::memory_order_relaxed);
+    out << std::left << std::setw(18) << "phase" << std::right
+        << std::setw(16) << "cycles" << std::setw(12) << "calls"
+        << std::setw(14) << "cycles/call" << std::setw(9) << "share"
+        << std::endl;
+    for (int i = 0; i < NUM_STATS_PHASES; i++) {
+        uint64_t cycles = searchStats.cycles[i].load(std::memory_order_relaxed);
+        uint64_t calls = searchStats.calls[i].load(std::memory_order_relaxed);
+        out << std::left << std::setw(18) << PHASE_NAMES[i] << std::right
+            << std::setw(16) << cycles << std::setw(12) << calls
+            << std::setw(14) << (calls ? cycles / calls : 0)
+            << std::fixed << std::setprecision(1) << std::setw(8)
+            << (total ? 100.0 * cycles / total : 0.0) << "%" << std::endl;
+    }
+    for (int i = 0; i < NUM_STATS_COUNTS; i++) {
+        out << std::left << std::setw(18) << COUNT_NAMES[i] << std::right
+            << std::setw(16)
+            << searchStats.counts[i].load(std::memory_order_relaxed)
+            << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
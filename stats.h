@@ -0,0 +1,90 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <atomic>
+#include <ostream>
+#include "types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/*
+ * Counters and cycle timers for the search's hot paths. They are always
+ * compiled in, and cost a predictable branch each when turned off. Timers
+ * measure cycles on x86 and nanoseconds elsewhere.
+ *
+ * Counters are updated with a relaxed load and store rather than an atomic
+ * add, which keeps them as cheap as a plain increment. Updates from threads
+ * running at the same time, as in the solver, may occasionally be lost.
+ */
+enum StatsPhase {
+    PHASE_SEARCH,
+    PHASE_SELECTION,
+    PHASE_EXPANSION,
+    PHASE_PLAYOUT,
+    PHASE_SCORING,
+    PHASE_BACKPROPAGATION,
+    NUM_STATS_PHASES
+};
+
+enum StatsCount {
+    COUNT_BOARD_COPIES,
+    COUNT_CHAIN_LOOKUPS,
+    COUNT_CHAIN_ALLOCATIONS,
+    COUNT_NODE_ALLOCATIONS,
+    NUM_STATS_COUNTS
+};
+
+struct SearchStats {
+    std::atomic<uint64_t> cycles[NUM_STATS_PHASES];
+    std::atomic<uint64_t> calls[NUM_STATS_PHASES];
+    std::atomic<uint64_t> counts[NUM_STATS_COUNTS];
+};
+
+extern bool statsEnabled;
+extern SearchStats searchStats;
+
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline void addStat(std::atomic<uint64_t> &stat, uint64_t n) {
+    stat.store(stat.load(std::memory_order_relaxed) + n,
+        std::memory_order_relaxed);
+}
+
+inline void countStat(StatsCount count) {
+    if (statsEnabled)
+        addStat(searchStats.counts[count], 1);
+}
+
+// Adds the cycles from its construction to its destruction to a phase
+class PhaseTimer {
+public:
+    PhaseTimer(StatsPhase p) : phase(p), start(statsEnabled ? readCycles() : 0) {}
+
+    ~PhaseTimer() {
+        if (start) {
+            addStat(searchStats.cycles[phase], readCycles() - start);
+            addStat(searchStats.calls[phase], 1);
+        }
+    }
+
+private:
+    StatsPhase phase;
+    uint64_t start;
+};
+
+void setStatsEnabled(bool enabled);
+void resetStats();
+void printStats(std::ostream &out);
+
+#endif
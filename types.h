@@ -42,10 +42,10 @@ inline int getY(Move m) {
 /*
  * A basic arraylist implementation for storing movelists, etc.
  */
-template <class T>
+template <class T, int N = 512>
 class GoArrayList {
 public:
-    T arrayList[512];
+    T arrayList[N];
     unsigned int length;
 
     GoArrayList() {